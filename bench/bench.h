@@ -0,0 +1,29 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+// the fastest of repeats runs of fn, in seconds. the fastest run is the one least disturbed by
+// everything else on the machine
+template <typename F>
+double bestSeconds(int repeats, F&& fn) {
+	double best = 1e30;
+	for (int r = 0; r < repeats; ++r) {
+		auto start = chrono::steady_clock::now();
+		fn();
+		best = std::min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+// argv[i] as an int, fallback when it isn't there
+inline int intArg(int argc, char** argv, int i, int fallback) {
+	return argc > i ? atoi(argv[i]) : fallback;
+}
+
+#endif
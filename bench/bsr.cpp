@@ -0,0 +1,173 @@
+#include "headless.h"
+#include "cage.h"
+#include "bsr.h"
+#include "bench.h"
+
+#include <thread>
+#include <tuple>
+#include <random>
+
+// BlockSparseMatrix against naive triplet assembly on Cube lattices. every step the triplet way
+// collects a (row, column, block) per spring end and node, sorts them and sums duplicates into
+// compressed rows, where the bsr matrix keeps its pattern and only refills the values. both then
+// multiply the same vector, next to the matrix-free product over the springs the implicit solver
+// uses by default. the bsr product is timed again over 1..N threads.
+// usage: bench_bsr [length] [nodes per length] [max threads] [repeats]
+
+struct TripletMatrix {
+	vector<unsigned int> rowOffsets;
+	vector<unsigned int> columns;
+	vector<mat3> values;
+
+	void assemble(const CageTopology& topo, size_t numNodes, const vector<mat3>& blocks) {
+		vector<tuple<unsigned int, unsigned int, mat3>> triplets;
+		triplets.reserve(numNodes + 4 * topo.numSprings());
+		for (size_t i = 0; i < numNodes; ++i) {
+			triplets.emplace_back((unsigned int)i, (unsigned int)i, mat3(1.0f));
+		}
+		for (size_t s = 0; s < topo.numSprings(); ++s) {
+			unsigned int a = topo.v0[s];
+			unsigned int b = topo.v1[s];
+			triplets.emplace_back(a, a, blocks[s]);
+			triplets.emplace_back(b, b, blocks[s]);
+			triplets.emplace_back(a, b, -blocks[s]);
+			triplets.emplace_back(b, a, -blocks[s]);
+		}
+		sort(triplets.begin(), triplets.end(), [](const tuple<unsigned int, unsigned int, mat3>& p, const tuple<unsigned int, unsigned int, mat3>& q) {
+			return get<0>(p) != get<0>(q) ? get<0>(p) < get<0>(q) : get<1>(p) < get<1>(q);
+		});
+
+		rowOffsets.assign(numNodes + 1, 0);
+		columns.clear();
+		values.clear();
+		for (size_t t = 0; t < triplets.size(); ++t) {
+			unsigned int row = get<0>(triplets[t]);
+			unsigned int column = get<1>(triplets[t]);
+			if (t > 0 && get<0>(triplets[t - 1]) == row && get<1>(triplets[t - 1]) == column) {
+				values.back() += get<2>(triplets[t]);
+				continue;
+			}
+			columns.push_back(column);
+			values.push_back(get<2>(triplets[t]));
+			++rowOffsets[row + 1];
+		}
+		for (size_t i = 0; i < numNodes; ++i) {
+			rowOffsets[i + 1] += rowOffsets[i];
+		}
+	}
+
+	void multiply(const aligned_vector<vec3>& x, aligned_vector<vec3>& y) const {
+		for (size_t i = 0; i + 1 < rowOffsets.size(); ++i) {
+			vec3 sum(0.0f);
+			for (unsigned int k = rowOffsets[i]; k < rowOffsets[i + 1]; ++k) {
+				sum += values[k] * x[columns[k]];
+			}
+			y[i] = sum;
+		}
+	}
+};
+
+void run(int length, int npl, int maxThreads, int repeats) {
+	ThreadPool::shared().resize(1);
+	Cube cube(length, npl);
+	mt19937 rng(184);
+	uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+	for (auto& p : cube.pts.position) {
+		p += vec3(jitter(rng), jitter(rng), jitter(rng));
+	}
+	const CageTopology& topo = cube.shape->topo;
+	const size_t n = cube.pts.size();
+	const size_t numSprings = topo.numSprings();
+
+	// a stiffness block k d d^T per spring, what the implicit solver's jacobian looks like
+	vector<mat3> blocks(numSprings);
+	double blockSeconds = bestSeconds(repeats, [&] {
+		for (size_t s = 0; s < numSprings; ++s) {
+			vec3 d = normalize(cube.pts.position[topo.v0[s]] - cube.pts.position[topo.v1[s]]);
+			blocks[s] = topo.k[s] * outerProduct(d, d);
+		}
+	});
+
+	TripletMatrix triplets;
+	double tripletSeconds = bestSeconds(repeats, [&] { triplets.assemble(topo, n, blocks); });
+
+	double patternSeconds = bestSeconds(repeats, [&] {
+		BlockSparseMatrix fresh;
+		fresh.build(topo, n);
+	});
+	BlockSparseMatrix A;
+	A.build(topo, n);
+	double refillSeconds = bestSeconds(repeats, [&] {
+		A.setZero();
+		for (size_t i = 0; i < n; ++i) {
+			A.values[A.diagonalSlot[i]] = mat3(1.0f);
+		}
+		forEachSpringBatch(topo, [&](size_t begin, size_t end) {
+			for (size_t s = begin; s < end; ++s) {
+				A.addSpring(s, topo.v0[s], topo.v1[s], blocks[s]);
+			}
+		});
+	});
+
+	aligned_vector<vec3> x(n);
+	aligned_vector<vec3> y(n);
+	aligned_vector<vec3> yTriplet(n);
+	aligned_vector<vec3> yFree(n);
+	for (size_t i = 0; i < n; ++i) {
+		x[i] = vec3(sin(float(i)), cos(float(i)), sin(3.0f * i));
+	}
+	double bsrSeconds = bestSeconds(repeats, [&] { A.multiply(x, y); });
+	double tripletProductSeconds = bestSeconds(repeats, [&] { triplets.multiply(x, yTriplet); });
+	double freeSeconds = bestSeconds(repeats, [&] {
+		for (size_t i = 0; i < n; ++i) {
+			yFree[i] = x[i];
+		}
+		forEachSpringBatch(topo, [&](size_t begin, size_t end) {
+			for (size_t s = begin; s < end; ++s) {
+				vec3 t = blocks[s] * (x[topo.v0[s]] - x[topo.v1[s]]);
+				yFree[topo.v0[s]] += t;
+				yFree[topo.v1[s]] -= t;
+			}
+		});
+	});
+
+	float largest = 0.0f;
+	float difference = 0.0f;
+	for (size_t i = 0; i < n; ++i) {
+		largest = std::max(largest, glm::length(y[i]));
+		difference = std::max(difference, std::max(glm::length(y[i] - yTriplet[i]), glm::length(y[i] - yFree[i])));
+	}
+
+	printf("\nCube(%d, %d): %zu nodes, %zu springs, %zu blocks\n", length, npl, n, numSprings, A.numBlocks());
+	printf("  spring blocks                     %9.3f ms\n", blockSeconds * 1e3);
+	printf("  triplet collect + sort + compress %9.3f ms\n", tripletSeconds * 1e3);
+	printf("  bsr refill                        %9.3f ms\n", refillSeconds * 1e3);
+	printf("  bsr pattern, once per topology    %9.3f ms\n", patternSeconds * 1e3);
+	printf("  product: bsr %.3f ms, triplet %.3f ms, matrix-free %.3f ms, largest difference %.2g of %.2g\n",
+		bsrSeconds * 1e3, tripletProductSeconds * 1e3, freeSeconds * 1e3, difference, largest);
+
+	printf("  bsr product by threads:");
+	for (int threads = 1; threads <= maxThreads; ++threads) {
+		ThreadPool::shared().resize(threads);
+		double seconds = bestSeconds(repeats, [&] { A.multiply(x, y); });
+		printf(" %d: %.3f ms", threads, seconds * 1e3);
+	}
+	printf("\n");
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	int maxThreads = intArg(argc, argv, 3, std::max(1u, thread::hardware_concurrency()));
+	int repeats = intArg(argc, argv, 4, 10);
+
+	int length = intArg(argc, argv, 1, 0);
+	if (length > 0) {
+		run(length, intArg(argc, argv, 2, 3), maxThreads, repeats);
+		return 0;
+	}
+	const int sizes[][2] = { { 8, 3 }, { 10, 4 } };
+	for (auto& size : sizes) {
+		run(size[0], size[1], maxThreads, repeats);
+	}
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include "headless.h"
+#include "cage.h"
+#include "bench.h"
+
+// what FEM_STEP buys over the spring lattice and what it costs. the cube is compressed by a small
+// uniform strain along an axis, a face diagonal and a body diagonal, and the elastic energy of each
+// model gives its stiffness in that direction, 2 E / (strain^2 volume). an isotropic material has
+// the same stiffness every way, the ratio of the stiffest direction to the softest is the
+// anisotropy. then both modes step the cube as it drops, per substep and per tick at the substeps
+// each needs to stay stable.
+// usage: bench_fem [length] [nodes per length] [strain] [ticks]
+
+const float DT = 1.0f / 60.0f;
+
+struct Direction {
+	const char* name;
+	vec3 axis;
+};
+
+const Direction DIRECTIONS[] = {
+	{ "axis", vec3(1.0f, 0.0f, 0.0f) },
+	{ "face diagonal", normalize(vec3(1.0f, 1.0f, 0.0f)) },
+	{ "body diagonal", normalize(vec3(1.0f, 1.0f, 1.0f)) },
+};
+
+// the cube's rest nodes squeezed by strain along axis, about its center
+NodeStore compressed(const Cube& cube, vec3 axis, float strain) {
+	NodeStore pts = cube.pts;
+	vec3 center(0.0f);
+	for (auto& p : pts.position) {
+		center += p;
+	}
+	center /= float(pts.size());
+	for (size_t i = 0; i < pts.size(); ++i) {
+		pts.position[i] -= strain * dot(pts.position[i] - center, axis) * axis;
+		pts.previous[i] = pts.position[i];
+	}
+	return pts;
+}
+
+double springEnergy(const CageTopology& topo, const NodeStore& pts) {
+	SpringEnergy energy;
+	vector<vec3> force(pts.size(), vec3(0.0f));
+	springForcesScalar(topo, 0, topo.numSprings(), pts.position.data(), pts.previous.data(), force.data(), 1.0f, &energy);
+	return energy.potential;
+}
+
+// seconds per tick and substeps per tick of the cube dropping in mode
+double tickSeconds(int length, int npl, StepMode mode, int ticks, int& substeps) {
+	Cube cube(length, npl, vec3(0.0f, length / 2.0f + 0.5f, 0.0f));
+	cube.stepMode = mode;
+	cube.sleepMonitor.sleepTime = 1e9f;
+	substeps = 0;
+	auto begin = chrono::steady_clock::now();
+	for (int t = 0; t < ticks; ++t) {
+		int s = cube.substepsFor(DT);
+		cube.tick(nullptr, DT, s);
+		substeps += s;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	substeps /= ticks;
+	return seconds / ticks;
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	int length = intArg(argc, argv, 1, 4);
+	int npl = intArg(argc, argv, 2, 3);
+	float strain = intArg(argc, argv, 3, 10) * 1e-3f;
+	int ticks = intArg(argc, argv, 4, 60);
+
+	Cube cube(length, npl);
+	FemSolver& fem = cube.femSolver;
+	fem.update(cube.pts, cube.shape->grid, cube.shape->topo);
+	const double volume = double(length) * length * length;
+	printf("Cube(%d, %d): %zu nodes, %zu springs, %zu tets, strain %g\n\n", length, npl, cube.pts.size(),
+		cube.shape->topo.numSprings(), fem.numElements(), strain);
+
+	printf("%-16s %16s %16s\n", "stiffness", "springs", "fem");
+	double lo[2] = { INFINITY, INFINITY };
+	double hi[2] = { 0.0, 0.0 };
+	for (const Direction& d : DIRECTIONS) {
+		NodeStore pts = compressed(cube, d.axis, strain);
+		double k[2] = { springEnergy(cube.shape->topo, pts), fem.potential(pts) };
+		for (int m = 0; m < 2; ++m) {
+			k[m] *= 2.0 / (double(strain) * strain * volume);
+			lo[m] = std::min(lo[m], k[m]);
+			hi[m] = std::max(hi[m], k[m]);
+		}
+		printf("%-16s %16.1f %16.1f\n", d.name, k[0], k[1]);
+	}
+	printf("%-16s %16.3f %16.3f\n", "stiffest/softest", hi[0] / lo[0], hi[1] / lo[1]);
+
+	int substeps[2];
+	double seconds[2] = { tickSeconds(length, npl, FUSED_STEP, ticks, substeps[0]), tickSeconds(length, npl, FEM_STEP, ticks, substeps[1]) };
+	printf("\n%-16s %16s %16s\n", "cost", "fused springs", "fem");
+	printf("%-16s %16d %16d\n", "substeps / tick", substeps[0], substeps[1]);
+	printf("%-16s %16.3f %16.3f\n", "ms / substep", seconds[0] / substeps[0] * 1e3, seconds[1] / substeps[1] * 1e3);
+	printf("%-16s %16.3f %16.3f\n", "ms / tick", seconds[0] * 1e3, seconds[1] * 1e3);
+	return 0;
+}
@@ -0,0 +1,87 @@
+#include "headless.h"
+#include "cage.h"
+#include "bench.h"
+
+#include <memory>
+
+// stability and cost of the explicit fused step against the implicit one as the springs stiffen. a
+// Cube drops onto the floor and settles for two seconds of 1/60 ticks. a run that goes non-finite or
+// stretches a spring past its rest length counts as exploded. strain is the largest over the second
+// second, when the cube should be resting.
+// usage: bench_implicit [length] [nodes per length] [ticks]
+
+const float DT = 1.0f / 60.0f;
+
+struct Run {
+	StepMode mode;
+	int substeps;
+};
+
+// the cube's shape with every spring's k scaled
+shared_ptr<const CageShape> stiffened(const CageShape& shape, float scale) {
+	vector<Spring> springs = shape.springs;
+	for (auto& s : springs) {
+		s.k *= scale;
+	}
+	return make_shared<CageShape>(move(springs), shape.numNodes(), shape.grid);
+}
+
+float maxStrain(const Cage& cage) {
+	float strain = 0.0f;
+	for (auto& s : cage.shape->springs) {
+		float len = distance(cage.pts.position[s.v0], cage.pts.position[s.v1]);
+		strain = std::max(strain, fabs(len - s.restLength) / s.restLength);
+	}
+	return strain;
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	int length = intArg(argc, argv, 1, 6);
+	int npl = intArg(argc, argv, 2, 2);
+	int ticks = intArg(argc, argv, 3, 120);
+
+	const float scales[] = { 1.0f, 100.0f, 1000.0f };
+	const Run runs[] = {
+		{ FUSED_STEP, 1 }, { FUSED_STEP, 8 }, { FUSED_STEP, 16 }, { FUSED_STEP, 32 }, { IMPLICIT_STEP, 1 },
+	};
+
+	printf("Cube(%d, %d), %d ticks of 1/60 s\n", length, npl, ticks);
+	printf("%-8s %-10s %9s %10s %11s %8s\n", "k", "mode", "substeps", "ms / tick", "max strain", "cg its");
+	for (float scale : scales) {
+		for (const Run& run : runs) {
+			Cube cube(length, npl, vec3(0.0f, length / 2.0f + 0.5f, 0.0f));
+			cube.setShape(stiffened(*cube.shape, scale));
+			cube.stepMode = run.mode;
+			// keep it stepping through the whole run
+			cube.sleepMonitor.sleepTime = 1e9f;
+
+			float strain = 0.0f;
+			double iterations = 0.0;
+			bool exploded = false;
+			auto start = chrono::steady_clock::now();
+			for (int t = 0; t < ticks && !exploded; ++t) {
+				cube.tick(nullptr, DT, run.substeps);
+				iterations += cube.implicitSolver.lastIterations;
+				float s = maxStrain(cube);
+				exploded = !std::isfinite(s) || s > 1.0f;
+				if (t >= ticks / 2) {
+					strain = std::max(strain, s);
+				}
+			}
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+			printf("%-8g %-10s %9d", cube.shape->springs[0].k, run.mode == IMPLICIT_STEP ? "implicit" : "explicit", run.substeps);
+			if (exploded) {
+				printf(" %10s\n", "exploded");
+				continue;
+			}
+			printf(" %10.3f %11.4f", seconds / ticks * 1e3, strain);
+			if (run.mode == IMPLICIT_STEP) {
+				printf(" %8.1f", iterations / ticks);
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
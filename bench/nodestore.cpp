@@ -0,0 +1,104 @@
+#include "headless.h"
+#include "cage.h"
+#include "bench.h"
+
+// the per node passes of a step over the old array of PointMass against the NodeStore arrays.
+// a pass over PointMass drags every field through the cache, a pass over the store only the
+// arrays it touches. usage: bench_nodestore [length] [nodes per length] [repeats]
+
+const float DT = 1.0f / 480.0f;
+
+void gravityAos(vector<PointMass>& nodes) {
+	for (auto& p : nodes) {
+		p.forces = GRAVITY * p.mass;
+	}
+}
+
+void gravitySoa(NodeStore& pts) {
+	for (size_t i = 0; i < pts.size(); ++i) {
+		pts.force[i] = GRAVITY * pts.mass[i];
+	}
+}
+
+void verletAos(vector<PointMass>& nodes) {
+	for (auto& p : nodes) {
+		vec3 next = p.Position + (p.Position - p.previousPosition) + p.forces / p.mass * DT * DT;
+		p.previousPosition = p.Position;
+		p.Position = next;
+	}
+}
+
+void verletSoa(NodeStore& pts) {
+	for (size_t i = 0; i < pts.size(); ++i) {
+		vec3 next = pts.position[i] + (pts.position[i] - pts.previous[i]) + pts.force[i] * pts.invMass[i] * DT * DT;
+		pts.previous[i] = pts.position[i];
+		pts.position[i] = next;
+	}
+}
+
+// springForcesScalar with the endpoints read out of PointMass
+void springsAos(const CageTopology& topo, vector<PointMass>& nodes) {
+	const float invDt = 1.0f / DT;
+	for (size_t s = 0; s < topo.numSprings(); ++s) {
+		PointMass& a = nodes[topo.v0[s]];
+		PointMass& b = nodes[topo.v1[s]];
+		vec3 ab = a.Position - b.Position;
+		float len2 = dot(ab, ab);
+		if (len2 <= SPRING_MIN_LENGTH2) {
+			continue;
+		}
+		float invLen = 1.0f / sqrt(len2);
+		vec3 dir = ab * invLen;
+		vec3 vDiff = (ab - (a.previousPosition - b.previousPosition)) * invDt;
+		float magnitude = topo.k[s] * (len2 * invLen - topo.restLength[s]) + topo.kd[s] * dot(vDiff, dir);
+		a.forces -= magnitude * dir;
+		b.forces += magnitude * dir;
+	}
+}
+
+void springsSoa(const CageTopology& topo, NodeStore& pts) {
+	springForcesScalar(topo, 0, topo.numSprings(), pts.position.data(), pts.previous.data(), pts.force.data(), 1.0f / DT);
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	int length = intArg(argc, argv, 1, 10);
+	int npl = intArg(argc, argv, 2, 10);
+	int repeats = intArg(argc, argv, 3, 5);
+
+	Cube cube(length, npl);
+	NodeStore soa = cube.pts;
+	vector<PointMass> aos;
+	for (size_t i = 0; i < soa.size(); ++i) {
+		aos.push_back(PointMass(soa.position[i], soa.mass[i]));
+	}
+	const CageTopology& topo = cube.shape->topo;
+	const double n = (double)soa.size();
+
+	printf("Cube(%d, %d): %zu nodes, %zu springs, PointMass is %zu bytes\n", length, npl, soa.size(), topo.numSprings(), sizeof(PointMass));
+	printf("%-10s %12s %12s %8s %16s %16s\n", "pass", "PointMass ms", "NodeStore ms", "speedup", "PointMass GB/s", "NodeStore GB/s");
+
+	// bytes per node a streaming pass has to move: the whole struct for PointMass, the arrays it
+	// reads and writes for the store. the spring pass hops between nodes, it gets no bandwidth figure
+	auto row = [&](const char* name, double aosSeconds, double soaSeconds, double soaBytes) {
+		printf("%-10s %12.3f %12.3f %7.2fx", name, aosSeconds * 1e3, soaSeconds * 1e3, aosSeconds / soaSeconds);
+		if (soaBytes > 0.0) {
+			printf(" %16.2f %16.2f", n * sizeof(PointMass) / aosSeconds * 1e-9, n * soaBytes / soaSeconds * 1e-9);
+		}
+		printf("\n");
+	};
+
+	row("gravity",
+		bestSeconds(repeats, [&] { gravityAos(aos); }),
+		bestSeconds(repeats, [&] { gravitySoa(soa); }),
+		sizeof(float) + sizeof(vec3));
+	row("verlet",
+		bestSeconds(repeats, [&] { verletAos(aos); }),
+		bestSeconds(repeats, [&] { verletSoa(soa); }),
+		sizeof(float) + 5 * sizeof(vec3));
+	row("springs",
+		bestSeconds(repeats, [&] { springsAos(topo, aos); }),
+		bestSeconds(repeats, [&] { springsSoa(topo, soa); }),
+		0.0);
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include "headless.h"
+#include "cage.h"
+#include "bench.h"
+
+// throughput and accuracy of the cage precisions on the same Cube: double, mixed (float nodes,
+// double forces), float with the scalar kernel and float with the simd kernel. every run is the
+// fused step with scatter forces at a fixed substep count, dropped from y = 5. the accuracy report
+// is each run's node positions against the double run's.
+// usage: bench_precision [length] [nodes per length] [ticks] [substeps]
+
+const float DT = 1.0f / 60.0f;
+const int REPORT_TICKS[] = { 10, 30, 60, 120, 240, 480 };
+
+// largest and mean distance of c's nodes from ref's
+template <typename C>
+void positionError(const C& c, const DoubleCube& ref, double& largest, double& mean) {
+	largest = 0.0;
+	mean = 0.0;
+	for (size_t i = 0; i < ref.pts.size(); ++i) {
+		double d = distance(dvec3(c.pts.position[i]), ref.pts.position[i]);
+		largest = std::max(largest, d);
+		mean += d;
+	}
+	mean /= ref.pts.size();
+}
+
+template <typename C>
+void prepare(C& c, SpringKernel kernel) {
+	c.stepMode = FUSED_STEP;
+	c.forceEvaluation = SCATTER_FORCES;
+	c.springKernel = kernel;
+	c.sleepMonitor.sleepTime = 1e9f;
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	int length = intArg(argc, argv, 1, 6);
+	int npl = intArg(argc, argv, 2, 2);
+	int ticks = intArg(argc, argv, 3, 240);
+	int substeps = intArg(argc, argv, 4, 8);
+	const vec3 start(0.0f, 5.0f, 0.0f);
+
+	DoubleCube ref(length, npl, start);
+	MixedCube mixed(length, npl, start);
+	Cube scalar(length, npl, start);
+	Cube simd(length, npl, start);
+	prepare(ref, SCALAR_KERNEL);
+	prepare(mixed, SCALAR_KERNEL);
+	prepare(scalar, SCALAR_KERNEL);
+	prepare(simd, SIMD_KERNEL);
+
+	const size_t springs = ref.shape->topo.numSprings();
+	printf("Cube(%d, %d): %zu nodes, %zu springs, %d ticks of %d substeps\n\n", length, npl, ref.pts.size(), springs, ticks, substeps);
+
+	double seconds[4] = { 0.0, 0.0, 0.0, 0.0 };
+	auto timed = [&](int k, auto& cage) {
+		auto begin = chrono::steady_clock::now();
+		cage.tick(nullptr, DT, substeps);
+		seconds[k] += chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+	};
+
+	printf("position error against double, max / mean in m\n");
+	printf("%6s %25s %25s %25s\n", "tick", "mixed", "float scalar", "float simd");
+	size_t report = 0;
+	for (int t = 1; t <= ticks; ++t) {
+		timed(0, ref);
+		timed(1, mixed);
+		timed(2, scalar);
+		timed(3, simd);
+		if (report < sizeof(REPORT_TICKS) / sizeof(REPORT_TICKS[0]) && t == REPORT_TICKS[report]) {
+			++report;
+			printf("%6d", t);
+			double largest, mean;
+			positionError(mixed, ref, largest, mean);
+			printf("     %9.2e / %9.2e", largest, mean);
+			positionError(scalar, ref, largest, mean);
+			printf("     %9.2e / %9.2e", largest, mean);
+			positionError(simd, ref, largest, mean);
+			printf("     %9.2e / %9.2e\n", largest, mean);
+		}
+	}
+
+	const char* names[4] = { "double", "mixed", "float scalar", "float simd" };
+	const double steps = (double)ticks * substeps;
+	printf("\n%-14s %10s %12s\n", "precision", "us / step", "Msprings/s");
+	for (int k = 0; k < 4; ++k) {
+		printf("%-14s %10.1f %12.1f\n", names[k], seconds[k] / steps * 1e6, springs * steps / seconds[k] * 1e-6);
+	}
+	return 0;
+}
@@ -0,0 +1,83 @@
+#include "headless.h"
+#include "cage.h"
+#include "bench.h"
+
+#include <thread>
+#include <random>
+
+// the spring force pass of a perturbed Cube with the shared pool resized to 1, 2, .. threads:
+// scatter over the colored spring batches with the scalar and the simd kernel, and gather over the
+// node incidence index. prints ms per pass, the fastest strategy and its speedup over one thread.
+// without a length, or with length 0, it runs a few cube sizes, small to large.
+// usage: bench_springs [length] [nodes per length] [max threads] [repeats]
+
+const float DT = 1.0f / 480.0f;
+
+struct Strategy {
+	const char* name;
+	ForceEvaluation evaluation;
+	SpringKernel kernel;
+};
+
+const Strategy STRATEGIES[] = {
+	{ "scatter scalar", SCATTER_FORCES, SCALAR_KERNEL },
+	{ "scatter simd", SCATTER_FORCES, SIMD_KERNEL },
+	{ "gather", GATHER_FORCES, SCALAR_KERNEL },
+};
+const int NUM_STRATEGIES = sizeof(STRATEGIES) / sizeof(STRATEGIES[0]);
+
+void run(int length, int npl, int maxThreads, int repeats) {
+	Cube cube(length, npl);
+	mt19937 rng(184);
+	uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+	for (auto& p : cube.pts.position) {
+		p += vec3(jitter(rng), jitter(rng), jitter(rng));
+	}
+	const CageTopology& topo = cube.shape->topo;
+	printf("\nCube(%d, %d): %zu nodes, %zu springs in %zu colors of %zu blocks\n", length, npl,
+		cube.pts.size(), topo.numSprings(), topo.numColors(), topo.numBlocks());
+	printf("%8s", "threads");
+	for (const Strategy& s : STRATEGIES) {
+		printf(" %14s", s.name);
+	}
+	printf(" %16s %8s\n", "fastest", "speedup");
+
+	double single[NUM_STRATEGIES];
+	for (int threads = 1; threads <= maxThreads; ++threads) {
+		ThreadPool::shared().resize(threads);
+		printf("%8d", threads);
+		int fastest = 0;
+		double seconds[NUM_STRATEGIES];
+		for (int s = 0; s < NUM_STRATEGIES; ++s) {
+			cube.forceEvaluation = STRATEGIES[s].evaluation;
+			cube.springKernel = STRATEGIES[s].kernel;
+			seconds[s] = bestSeconds(repeats, [&] { cube.springCorrectionForces(DT); });
+			if (threads == 1) {
+				single[s] = seconds[s];
+			}
+			if (seconds[s] < seconds[fastest]) {
+				fastest = s;
+			}
+			printf(" %11.3f ms", seconds[s] * 1e3);
+		}
+		printf(" %16s %7.2fx\n", STRATEGIES[fastest].name, single[fastest] / seconds[fastest]);
+	}
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	printf("spring kernel width %d\n", SPRING_KERNEL_WIDTH);
+	int maxThreads = intArg(argc, argv, 3, std::max(1u, thread::hardware_concurrency()));
+	int repeats = intArg(argc, argv, 4, 5);
+
+	int length = intArg(argc, argv, 1, 0);
+	if (length > 0) {
+		run(length, intArg(argc, argv, 2, 5), maxThreads, repeats);
+		return 0;
+	}
+	const int sizes[][2] = { { 1, 4 }, { 3, 4 }, { 5, 5 }, { 10, 5 } };
+	for (auto& size : sizes) {
+		run(size[0], size[1], maxThreads, repeats);
+	}
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include "headless.h"
+#include "world.h"
+#include "bench.h"
+
+#include <thread>
+
+// CageWorld throughput as the instance count grows, against the same number of separate Cubes in
+// FUSED_STEP with the simd kernel. every instance starts at rest a little above the floor, so both
+// keep stepping the whole run. prints spring evaluations per second and the world's speedup.
+// usage: bench_world [length] [nodes per length] [ticks] [substeps]
+
+const float DT = 1.0f / 60.0f;
+const size_t COUNTS[] = { 1, 8, 64, 256, 1024 };
+
+vec3 offsetOf(size_t instance) {
+	return vec3(3.0f * (instance % 32), 0.0f, 3.0f * (instance / 32));
+}
+
+int main(int argc, char** argv) {
+	initHeadless();
+	int length = intArg(argc, argv, 1, 1);
+	int npl = intArg(argc, argv, 2, 4);
+	int ticks = intArg(argc, argv, 3, 30);
+	int substeps = intArg(argc, argv, 4, 8);
+	const vec3 start(0.0f, length / 2.0f + 0.25f, 0.0f);
+
+	Cube prototype(length, npl, start);
+	const size_t springs = prototype.shape->topo.numSprings();
+	printf("Cube(%d, %d): %zu nodes, %zu springs, %d ticks of %d substeps, %zu world lanes, %u threads\n\n", length, npl,
+		prototype.pts.size(), springs, ticks, substeps, WORLD_LANES, ThreadPool::shared().size());
+	printf("%10s %16s %16s %8s\n", "instances", "cubes Msprings/s", "world Msprings/s", "speedup");
+
+	for (size_t count : COUNTS) {
+		vector<unique_ptr<Cube>> cubes;
+		for (size_t k = 0; k < count; ++k) {
+			cubes.emplace_back(new Cube(length, npl, start + offsetOf(k)));
+			cubes.back()->stepMode = FUSED_STEP;
+			cubes.back()->springKernel = SIMD_KERNEL;
+			cubes.back()->sleepMonitor.sleepTime = 1e9f;
+		}
+		auto begin = chrono::steady_clock::now();
+		for (int t = 0; t < ticks; ++t) {
+			for (auto& cube : cubes) {
+				cube->tick(nullptr, DT, substeps);
+			}
+		}
+		double cubeSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+		double cubeRate = (double)count * springs * ticks * substeps / cubeSeconds;
+
+		CageWorld world(prototype);
+		for (size_t k = 0; k < count; ++k) {
+			world.add(offsetOf(k));
+		}
+		for (int t = 0; t < ticks; ++t) {
+			world.tick(DT, substeps);
+		}
+
+		printf("%10zu %16.1f %16.1f %7.2fx\n", count, cubeRate * 1e-6, world.springsPerSecond() * 1e-6,
+			world.springsPerSecond() / cubeRate);
+	}
+	return 0;
+}
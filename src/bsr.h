@@ -0,0 +1,149 @@
+#ifndef BSR_H
+#define BSR_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+
+// block sparse row matrix of 3x3 blocks over a cage's nodes, with a block at (i, i) and at (i, j)
+// for every spring between i and j. the pattern comes from the topology and is only rebuilt when
+// it changes, each step just refills the values. every spring knows the slots of its two
+// off-diagonal blocks, so a spring's contribution lands without a search
+class BlockSparseMatrix {
+	public:
+		// row i's blocks are values[rowOffsets[i] .. rowOffsets[i + 1]), columns ascending
+		aligned_vector<unsigned int> rowOffsets;
+		aligned_vector<unsigned int> columns;
+		aligned_vector<mat3> values;
+		// slot of row i's diagonal block
+		aligned_vector<unsigned int> diagonalSlot;
+		// slots of spring s's (v0, v1) and (v1, v0) blocks
+		aligned_vector<unsigned int> forwardSlot;
+		aligned_vector<unsigned int> backwardSlot;
+
+		size_t rows() const {
+			return diagonalSlot.size();
+		}
+
+		size_t numBlocks() const {
+			return columns.size();
+		}
+
+		// rebuilds the pattern if topo changed since the last call, returns whether it did
+		bool build(const CageTopology& topo, size_t numNodes) {
+			if (&topo == builtFor && topo.revision == builtRevision && rows() == numNodes) {
+				return false;
+			}
+
+			// the incidence index already lists each node's neighbours, springs doubled up between
+			// the same two nodes share a block
+			vector<vector<unsigned int>> pattern(numNodes);
+			for (size_t i = 0; i < numNodes; ++i) {
+				pattern[i].assign(1, (unsigned int)i);
+				for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+					pattern[i].push_back(topo.neighbor[e]);
+				}
+			}
+			setPattern(pattern);
+
+			forwardSlot.resize(topo.numSprings());
+			backwardSlot.resize(topo.numSprings());
+			for (size_t s = 0; s < topo.numSprings(); ++s) {
+				forwardSlot[s] = slot(topo.v0[s], topo.v1[s]);
+				backwardSlot[s] = slot(topo.v1[s], topo.v0[s]);
+			}
+
+			builtFor = &topo;
+			builtRevision = topo.revision;
+			return true;
+		}
+
+		// pattern from each row's columns, which must include the row's own diagonal. duplicates are
+		// dropped and the values zeroed. leaves the spring slots alone, only build() fills those
+		void setPattern(vector<vector<unsigned int>>& pattern) {
+			const size_t numRows = pattern.size();
+			rowOffsets.assign(numRows + 1, 0);
+			columns.clear();
+			for (size_t i = 0; i < numRows; ++i) {
+				vector<unsigned int>& row = pattern[i];
+				sort(row.begin(), row.end());
+				row.erase(unique(row.begin(), row.end()), row.end());
+				columns.insert(columns.end(), row.begin(), row.end());
+				rowOffsets[i + 1] = (unsigned int)columns.size();
+			}
+
+			values.assign(columns.size(), mat3(0.0f));
+			diagonalSlot.resize(numRows);
+			for (size_t i = 0; i < numRows; ++i) {
+				diagonalSlot[i] = slot(i, i);
+			}
+		}
+
+		// index of block (i, j) in values, which must be in the pattern
+		unsigned int slot(size_t i, size_t j) const {
+			auto first = columns.begin() + rowOffsets[i];
+			auto last = columns.begin() + rowOffsets[i + 1];
+			return (unsigned int)(lower_bound(first, last, (unsigned int)j) - columns.begin());
+		}
+
+		void setZero() {
+			ThreadPool::shared().parallelFor(0, values.size(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				fill(values.begin() + begin, values.begin() + end, mat3(0.0f));
+			});
+		}
+
+		// adds the symmetric spring block B the usual way, +B on both diagonals and -B off them.
+		// springs of one color never share a node, so forEachSpringBatch may call this in parallel
+		void addSpring(size_t s, unsigned int a, unsigned int b, const mat3& B) {
+			values[diagonalSlot[a]] += B;
+			values[diagonalSlot[b]] += B;
+			values[forwardSlot[s]] -= B;
+			values[backwardSlot[s]] -= B;
+		}
+
+		// y = A x, each row on its own so the rows split between threads freely
+		void multiply(const aligned_vector<vec3>& x, aligned_vector<vec3>& y) const {
+			ThreadPool::shared().parallelFor(0, rows(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 sum(0.0f);
+					for (unsigned int k = rowOffsets[i]; k < rowOffsets[i + 1]; ++k) {
+						sum += values[k] * x[columns[k]];
+					}
+					y[i] = sum;
+				}
+			});
+		}
+
+		void diagonal(aligned_vector<mat3>& out) const {
+			out.resize(rows());
+			ThreadPool::shared().parallelFor(0, rows(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					out[i] = values[diagonalSlot[i]];
+				}
+			});
+		}
+
+		// inverses of the diagonal blocks, the block jacobi preconditioner
+		void blockJacobi(aligned_vector<mat3>& out) const {
+			out.resize(rows());
+			ThreadPool::shared().parallelFor(0, rows(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					out[i] = inverse(values[diagonalSlot[i]]);
+				}
+			});
+		}
+
+	private:
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+};
+
+#endif
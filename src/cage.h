@@ -9,92 +9,633 @@
 #include <vector>
 #include <string>
 #include <random>
+#include <type_traits>
+#include <memory>
+#include <map>
+#include <mutex>
 
 using namespace std;
 using namespace glm;
 
 #include "shader.h"
 #include "mesh.h"
+#include "precision.h"
+#include "nodestore.h"
+#include "topology.h"
+#include "shape.h"
+#include "springkernel.h"
+#include "threadpool.h"
+#include "reorder.h"
+#include "implicit.h"
+#include "xpbd.h"
+#include "projective.h"
+#include "fem.h"
+#include "shapematch.h"
+#include "timestep.h"
+#include "sleep.h"
+#include "statehash.h"
+#include "diagnostics.h"
+#include "taskgraph.h"
+
+// which implementation springCorrectionForces runs
+enum SpringKernel {
+	SCALAR_KERNEL,
+	SIMD_KERNEL
+};
 
-struct PointMass {
-    vec3 Position;
-	vec3 previousPosition;
-	vec3 forces;
-	vec3 previousForces;
+// how spring forces reach the nodes. scatter walks the springs color by color and pushes
+// into both ends, gather walks the nodes and pulls from the incidence index
+enum ForceEvaluation {
+	SCATTER_FORCES,
+	GATHER_FORCES
+};
 
-    float mass;
+// how step() advances the cage. phased runs applyForces, applyUserInput, springCorrectionForces,
+// verletStep and satisfyConstraints one after another. fused folds everything except the spring
+// loop into a single node pass: with scatter forces the springs accumulate into a side buffer first,
+// with gather forces the node pass pulls them itself and the whole step is one pass.
+// implicit takes a linearized backward euler step, stable at stiffnesses verlet can't handle.
+// xpbd treats springs and the floor as compliant constraints and replaces springConstrain's clamp.
+// projective alternates spring projections with a prefactored global solve.
+// fem swaps the springs for co-rotational tets over the cage's lattice and steps them explicitly,
+// cages that aren't a lattice run fused instead.
+// shape matching drops the springs too and pulls the nodes toward a best fit rigid copy of the rest
+// shape, a cheap wobble for background cages
+enum StepMode {
+	PHASED_STEP,
+	FUSED_STEP,
+	IMPLICIT_STEP,
+	XPBD_STEP,
+	PROJECTIVE_STEP,
+	FEM_STEP,
+	SHAPE_MATCHING_STEP
+};
 
-    PointMass(vec3 pos, float m) {
-        Position = pos;
-    	previousPosition = pos;
+const vec3 GRAVITY = vec3(0.0f, -9.81f, 0.0f);
 
-    	forces = vec3(0, 0, 0);
-    	previousForces = vec3(0, 0, 0);
-        mass = m;
-    }
-};
+// arrow key push and the friction applied to driven nodes
+const float INPUT_STRENGTH = 19.81f;
+const float INPUT_FRICTION = 15.0f;
 
-enum SpringType {
-	EDGE,
-	SHEAR,
-	SHEAR_BODY,
-	BEND,
-	SURFACE
-};
+// nodes per chunk for the gather evaluation
+const size_t NODE_BATCH_GRAIN = 1024;
+
+// a cage of point masses and springs. P is a Precision from precision.h, FloatPrecision in real time
+// and DoublePrecision or MixedPrecision for reference runs. the implicit, xpbd, projective, fem and
+// shape matching modes and the simd kernel are float only, the other precisions run FUSED_STEP and
+// the scalar kernel instead
+template <typename P>
+class BasicCage {
+	public:
+		typedef typename P::Real Real;
+		typedef typename P::Accum Accum;
+		typedef vec<3, Real> vec_type;
+		typedef vec<3, Accum> accum_type;
 
-// enum springDirection
-// {
-//
-// };
+		BasicNodeStore<Real> pts;
+		vec3 pos;
 
-struct Spring {
-    // the indices of the two point masses attached
-    unsigned int v0;
-    unsigned int v1;
-	float restLength;
+		// springs, topology and lattice, shared with every cage built the same way. replaced
+		// through setShape, never edited
+		shared_ptr<const CageShape> shape;
+		SpringKernel springKernel = SIMD_KERNEL;
+		ForceEvaluation forceEvaluation = SCATTER_FORCES;
+		StepMode stepMode = FUSED_STEP;
+		ImplicitSolver implicitSolver;
+		XpbdSolver xpbdSolver;
+		ProjectiveSolver projectiveSolver;
+		FemSolver femSolver;
+		ShapeMatchingSolver shapeMatchingSolver;
+		TimestepController timestepController;
+		SleepMonitor sleepMonitor;
+
+		// deterministic runs hand the spring kernels one block at a time, so no range depends on the
+		// thread count, and fold every step's positions into stateHash. parallelReduce already sums
+		// in a fixed order and the node passes write one node each, so nothing else changes
+		bool deterministic = false;
+		StateHash stateHash;
+
+		// with collectStats set every step refreshes stats. the fused step gathers them inside its
+		// own spring and node passes, the other modes pay for a separate pass. it's meant to stay on
+		// in production with scatter forces only, about 5% on the fused step there. gather forces
+		// measure each spring in a scalar loop and pay 7-12%
+		bool collectStats = false;
+		CageStats stats;
+
+		// 1 for the nodes the arrow keys push on, the first half of the nodes as built
+		vector<unsigned char> driven;
+
+		BasicCage() {
+			shape = make_shared<CageShape>(vector<Spring>(), 0);
+		}
 
-    float k;
-	float kd;
+		BasicCage(vector<PointMass> pts, vector<Spring> springs, vec3 pos) {
+			this->pts.assign(pts);
+			this->pos = pos;
 
-	Spring(unsigned int v0, unsigned int v1, float k, float kd, float rl) {
-		this->v0 = v0;
-		this->v1 = v1;
-		this->k = k;
-		this->kd = kd;
+			resetDrivenNodes();
+			setShape(make_shared<CageShape>(move(springs), this->pts.size()));
+			refreshMesh();
+		}
 
-		// Set to some constant, its a cube so all would the same distance, how far are positions from one another typically
-		this->restLength = rl;
+	// the springs of the cage from now on, shape must have the cage's node count
+	void setShape(shared_ptr<const CageShape> shape) {
+		this->shape = move(shape);
+		indicesDirty = true;
+		wake();
 	}
-};
 
-class Cage {
-	public:
-		vector<PointMass> pts;
-		vector<Spring> springs;
-		vec3 pos;
+	void resetDrivenNodes() {
+		driven.assign(pts.size(), 0);
+		for (size_t i = 0; i < pts.size() - (pts.size() / 2); ++i) {
+			driven[i] = 1;
+		}
+	}
 
-		Cage() {
-			pts = vector<PointMass>();
-			springs = vector<Spring>();
+	// renumbers nodes for memory locality and sorts springs by their first endpoint, so the
+	// spring loops walk the node arrays mostly forward. the nodes, driven flags and the tick's start
+	// are permuted here, the springs and lattice go to a reordered shape, shared with cages reordered alike
+	void reorder(NodeOrdering ordering) {
+		vector<unsigned int> order;
+		switch (ordering) {
+			case MORTON_ORDER:
+				order = mortonOrder(restPosition());
+				break;
+			case ND_ORDER:
+				order = ndOrder(restPosition(), shape->topo);
+				break;
+			default:
+				order = rcmOrder(pts.size(), shape->springs);
+				break;
 		}
 
-		Cage(vector<PointMass> pts, vector<Spring> springs, vec3 pos) {
-			this->pts = pts;
-			this->springs = springs;
-			this->pos = pos;
+		pts.permute(order);
+
+		vector<unsigned char> oldDriven(driven);
+		for (size_t i = 0; i < order.size(); ++i) {
+			driven[i] = oldDriven[order[i]];
+		}
+		// the last tick's start, which frames between ticks blend from
+		if (tickStart.size() == order.size()) {
+			aligned_vector<vec_type> oldStart(tickStart);
+			for (size_t i = 0; i < order.size(); ++i) {
+				tickStart[i] = oldStart[order[i]];
+			}
+		}
+
+		setShape(shape->reordered(order));
+		refreshMesh();
+	}
+
+	// one fixed timestep tick of dt split into substeps. remembers where it started so
+	// refreshMesh(alpha) can draw frames that fall between two ticks
+	// a sleeping cage skips the tick unless there's input for it
+	void tick(GLFWwindow* window, float dt, int substeps, float floorY = 0.0f) {
+		if (!beginTick(readInputForce(window))) {
+			return;
+		}
+		for (int s = 0; s < substeps; ++s) {
+			stepForces(dt / substeps);
+			stepIntegrate(dt / substeps, floorY);
+			stepConstrain(floorY);
+			if (deterministic) {
+				stateHash.update(pts);
+			}
+		}
+		endTick(dt, substeps);
+	}
+
+	// tick as tasks of graph, one chain per cage: begin, forces, integrate and constrain for every
+	// substep, end. the chain starts after the tasks in after, the returned task ends it. the
+	// arrow keys are read by the caller, glfw only answers on the main thread
+	TaskGraph::TaskId addTickTasks(TaskGraph& graph, const string& name, vec3 inputForce, float dt, int substeps,
+								   float floorY = 0.0f, const vector<TaskGraph::TaskId>& after = vector<TaskGraph::TaskId>()) {
+		const float h = dt / substeps;
+		TaskGraph::TaskId last = graph.add(name + " begin", [this, inputForce] {
+			beginTick(inputForce);
+		}, after);
+		for (int s = 0; s < substeps; ++s) {
+			last = graph.add(name + " forces", [this, h] {
+				if (tickActive) {
+					stepForces(h);
+				}
+			}, { last });
+			last = graph.add(name + " integrate", [this, h, floorY] {
+				if (tickActive) {
+					stepIntegrate(h, floorY);
+				}
+			}, { last });
+			last = graph.add(name + " constrain", [this, floorY] {
+				if (tickActive) {
+					stepConstrain(floorY);
+					if (deterministic) {
+						stateHash.update(pts);
+					}
+				}
+			}, { last });
+		}
+		return graph.add(name + " end", [this, dt, substeps] {
+			endTick(dt, substeps);
+		}, { last });
+	}
+
+	// staging of the vertices refreshMesh(alpha) would upload as a task of graph, after after.
+	// uploadMesh sends them once the graph has run
+	TaskGraph::TaskId addStagingTask(TaskGraph& graph, const string& name, float alpha,
+									 const vector<TaskGraph::TaskId>& after = vector<TaskGraph::TaskId>()) {
+		return graph.add(name + " staging", [this, alpha] {
+			stageMesh(alpha);
+		}, after);
+	}
+
+	// the phases of a tick, tick() runs them in order. beginTick returns false when the cage sleeps
+	// through the tick, the phases and endTick then do nothing
+	bool beginTick(vec3 inputForce) {
+		stepInput = inputForce;
+		if (sleepMonitor.asleep) {
+			if (inputForce == vec3(0.0f)) {
+				tickActive = false;
+				return false;
+			}
+			wake();
+		}
 
-			setupMesh();
+		tickStart.assign(pts.position.begin(), pts.position.end());
+		tickActive = true;
+		return true;
+	}
+
+	void endTick(float dt, int substeps) {
+		if (!tickActive) {
+			return;
+		}
+		lastSubsteps = substeps;
+
+		if (sleepMonitor.update(pts, dt, dt / substeps)) {
+			// drop what motion is left so the cage wakes up from rest
+			pts.previous.assign(pts.position.begin(), pts.position.end());
+			tickStart.assign(pts.position.begin(), pts.position.end());
+		}
+	}
+
+	// anything that pushes on the cage from outside (contacts, scripted forces) must call this,
+	// a sleeping cage only notices input on its own
+	void wake() {
+		sleepMonitor.wake();
+		restUploaded = false;
+	}
+
+	// true when the last tick left the cage where it was: it slept through and nothing woke it since
+	bool restedLastTick() const {
+		return !tickActive && sleepMonitor.asleep;
+	}
+
+	// substeps a tick of dt needs to stay stable. the implicit, xpbd, projective and shape matching
+	// modes are unconditionally stable and take the tick in one step
+	int substepsFor(float dt) {
+		if (sleepMonitor.asleep) {
+			return lastSubsteps;
+		}
+		StepMode mode = activeStepMode();
+		if (mode == IMPLICIT_STEP || mode == XPBD_STEP || mode == PROJECTIVE_STEP || mode == SHAPE_MATCHING_STEP) {
+			return 1;
+		}
+		if constexpr (P::realTime) {
+			if (mode == FEM_STEP) {
+				femSolver.update(pts, shape->grid, shape->topo);
+				return femSolver.substeps(dt);
+			}
+		}
+		return timestepController.substeps(pts, shape->topo, dt, lastStepDt);
+	}
+
+	// one physics step, the same work main used to call phase by phase
+	void step(GLFWwindow* window, float dt, float floorY = 0.0f) {
+		stepInput = readInputForce(window);
+		stepForces(dt);
+		stepIntegrate(dt, floorY);
+		stepConstrain(floorY);
+		if (deterministic) {
+			stateHash.update(pts);
+		}
+	}
+
+	// a step in three phases. forces leaves every force the mode needs in place: the external ones,
+	// and the spring forces where the mode integrates them explicitly. integrate moves the nodes,
+	// constrain applies what clamps the mode keeps afterwards
+	void stepForces(float dt) {
+		// velocity lives in position - previous, rescale it when the step size changes
+		if (lastStepDt > 0.0f && dt != lastStepDt) {
+			const Real scale = Real(dt) / Real(lastStepDt);
+			for (size_t i = 0; i < pts.size(); ++i) {
+				pts.previous[i] = pts.position[i] - (pts.position[i] - pts.previous[i]) * scale;
+			}
+		}
+		lastStepDt = dt;
+
+		// the mode stays the same until the step is done
+		phaseMode = activeStepMode();
+		if (collectStats && phaseMode != FUSED_STEP) {
+			measureStats(dt);
+		}
+
+		switch (phaseMode) {
+			case FUSED_STEP:
+				fusedForces(dt);
+				break;
+			case PHASED_STEP:
+				applyForces(GRAVITY);
+				applyUserInput(stepInput, dt);
+				springCorrectionForces(dt);
+				break;
+			default:
+				applyExternalForces(stepInput, dt);
+				break;
+		}
+	}
+
+	void stepIntegrate(float dt, float floorY = 0.0f) {
+		switch (phaseMode) {
+			case FUSED_STEP:
+				fusedStep(stepInput, dt, floorY);
+				break;
+			case IMPLICIT_STEP:
+				implicitStep(dt, floorY);
+				break;
+			case XPBD_STEP:
+				xpbdStep(dt, floorY);
+				break;
+			case PROJECTIVE_STEP:
+				projectiveStep(dt, floorY);
+				break;
+			case FEM_STEP:
+				femStep(dt, floorY);
+				break;
+			case SHAPE_MATCHING_STEP:
+				shapeMatchingStep(dt, floorY);
+				break;
+			default:
+				verletStep(dt, 0.7f);
+				satisfyConstraints(floorY);
+				break;
+		}
+	}
+
+	void stepConstrain(float floorY = 0.0f) {
+		switch (phaseMode) {
+			case IMPLICIT_STEP:
+				satisfyConstraints(floorY);
+				springConstrain();
+				break;
+			case XPBD_STEP:
+				// the solver already keeps every spring at its length, the stretch clamp would fight it
+			case PROJECTIVE_STEP:
+			case FEM_STEP:
+				// there are no springs to clamp, the tets resist stretching themselves
+			case SHAPE_MATCHING_STEP:
+				break;
+			default:
+				springConstrain();
+				break;
+		}
+	}
+
+	// fills stats from the current state for the modes that don't measure inside their own passes
+	void measureStats(float dt) {
+		ThreadPool& pool = ThreadPool::shared();
+		const double invDt = 1.0 / dt;
+
+		stats = pool.parallelReduce(0, pts.size(), SOLVER_GRAIN, CageStats(), [&](size_t begin, size_t end) {
+			CageStats partial;
+			for (size_t i = begin; i < end; ++i) {
+				const dvec3 p(pts.position[i]);
+				const dvec3 v = (p - dvec3(pts.previous[i])) * invDt;
+				partial.kinetic += 0.5 * pts.mass[i] * dot(v, v);
+				partial.momentum += v * double(pts.mass[i]);
+				partial.gravitational -= pts.mass[i] * dot(dvec3(GRAVITY), p + dvec3(pos));
+			}
+			return partial;
+		}, mergeStats);
+
+		const CageTopology& topo = shape->topo;
+		SpringEnergy springs = pool.parallelReduce(0, topo.numSprings(), SOLVER_GRAIN, SpringEnergy(), [&](size_t begin, size_t end) {
+			SpringEnergy e;
+			for (size_t s = begin; s < end; ++s) {
+				double len = distance(dvec3(pts.position[topo.v0[s]]), dvec3(pts.position[topo.v1[s]]));
+				e.add(topo.k[s], len - topo.restLength[s], topo.restLength[s]);
+			}
+			return e;
+		}, [](const SpringEnergy& a, const SpringEnergy& b) {
+			SpringEnergy e;
+			e.potential = a.potential + b.potential;
+			e.maxStrain = std::max(a.maxStrain, b.maxStrain);
+			return e;
+		});
+		stats.springPotential = springs.potential;
+		stats.maxStrain = springs.maxStrain;
+		if constexpr (P::realTime) {
+			if (activeStepMode() == FEM_STEP) {
+				stats.springPotential = femSolver.potential(pts);
+			}
+		}
+	}
+
+	// node positions rounded to float, for the reorder passes that only need the rough shape
+	aligned_vector<vec3> floatPosition() const {
+		return aligned_vector<vec3>(pts.position.begin(), pts.position.end());
+	}
+
+	// where the nodes sit at rest: the lattice for lattice cages, the current positions for the rest
+	aligned_vector<vec3> restPosition() const {
+		const NodeGrid& grid = shape->grid;
+		if (grid.empty() || grid.coord.size() != pts.size()) {
+			return floatPosition();
+		}
+		aligned_vector<vec3> rest(pts.size());
+		for (size_t i = 0; i < rest.size(); ++i) {
+			rest[i] = vec3(grid.coord[i]) * grid.spacing;
+		}
+		return rest;
+	}
+
+	// stepMode, or FUSED_STEP in place of a float only mode or of FEM_STEP without a lattice
+	StepMode activeStepMode() const {
+		if (stepMode == FEM_STEP && shape->grid.empty()) {
+			return FUSED_STEP;
+		}
+		if (P::realTime || stepMode == PHASED_STEP) {
+			return stepMode;
+		}
+		return FUSED_STEP;
+	}
+
+	// the solver steps, pts.force holds the external forces from stepForces
+	void implicitStep(float dt, float floorY) {
+		if constexpr (P::realTime) {
+			implicitSolver.step(pts, shape->topo, dt, floorY - pos.y, &shape->grid);
+		}
+	}
+
+	void xpbdStep(float dt, float floorY) {
+		if constexpr (P::realTime) {
+			xpbdSolver.step(pts, shape->topo, dt, floorY - pos.y);
+		}
+	}
+
+	void projectiveStep(float dt, float floorY) {
+		if constexpr (P::realTime) {
+			projectiveSolver.step(pts, shape->topo, dt, floorY - pos.y);
+		}
+	}
+
+	void femStep(float dt, float floorY) {
+		if constexpr (P::realTime) {
+			femSolver.update(pts, shape->grid, shape->topo);
+			femSolver.step(pts, dt, floorY - pos.y);
+		}
+	}
+
+	void shapeMatchingStep(float dt, float floorY) {
+		if constexpr (P::realTime) {
+			shapeMatchingSolver.update(pts, shape->grid, shape->topo);
+			shapeMatchingSolver.step(pts, dt, floorY - pos.y);
+		}
+	}
+
+	// gravity everywhere plus input and drag on the driven nodes, overwriting pts.force
+	void applyExternalForces(vec3 inputForce, float dt) {
+		const Real invDt = Real(1) / Real(dt);
+		for (size_t i = 0; i < pts.size(); ++i) {
+			vec_type f = vec_type(GRAVITY) * pts.mass[i];
+			if (driven[i]) {
+				vec_type drag = -Real(INPUT_FRICTION) * (pts.position[i] - pts.previous[i]) * invDt * pts.mass[i];
+				f += vec_type(inputForce) + vec_type(drag.x, 0, drag.z);
+			}
+			pts.force[i] = f;
 		}
+	}
 
 	void updatePhysics(GLFWwindow* window, float dt) {
-		applyForces(vec3(0.0f, -9.81f, 0.0f));
+		applyForces(GRAVITY);
 		applyUserInput(window, dt);
 		springCorrectionForces(dt);
 	}
 
-	void applyUserInput(GLFWwindow* window, float dt) {
+	// the spring pass of the fused step: with scatter forces the springs go into springAccum,
+	// with gather forces fusedStep pulls them itself and there's nothing to do yet
+	void fusedForces(float dt) {
+		const size_t n = pts.size();
+		const Accum invDt = Accum(1) / Accum(dt);
+		scatterEnergy = SpringEnergy();
+
+		if (forceEvaluation == GATHER_FORCES) {
+			// neighbours are read from the current positions while results go to nextPosition
+			nextPosition.resize(n);
+		} else {
+			if (springAccum.size() != n) {
+				springAccum.assign(n, accum_type(0));
+			}
+			scatterSpringForces(springAccum.data(), invDt, collectStats ? &scatterEnergy : nullptr);
+		}
+	}
+
+	// external + input + spring forces, verlet and the floor clamp with one pass over the nodes,
+	// after fusedForces
+	void fusedStep(vec3 inputForce, float dt, float floorY) {
+		const size_t n = pts.size();
+		const Accum invDt = Accum(1) / Accum(dt);
+		const bool gather = forceEvaluation == GATHER_FORCES;
+		const bool measure = collectStats;
+
+		const vec_type* position = pts.position.data();
+		vec_type* previous = pts.previous.data();
+		vec_type* force = pts.force.data();
+		const Real* mass = pts.mass.data();
+		const Real* invMass = pts.invMass.data();
+		vec_type* next = gather ? nextPosition.data() : pts.position.data();
+		accum_type* accum = springAccum.data();
+		const CageTopology& topo = shape->topo;
+		const Accum dt2 = Accum(dt) * Accum(dt);
+
+		// everything below is done in Accum and rounded to Real on the way out
+		// while measuring each chunk sums m |v dt|^2, m v dt, m and m y, the constants go on at the end
+		auto nodePass = [&](size_t begin, size_t end) {
+			Accum twiceKineticDt2(0);
+			accum_type momentumDt(0);
+			Accum chunkMass(0);
+			Accum massHeight(0);
+			SpringEnergy gatherEnergy;
+			for (size_t i = begin; i < end; ++i) {
+				const accum_type p(position[i]);
+				const accum_type v_dt = p - accum_type(previous[i]);
+
+				if (measure) {
+					const accum_type mv_dt = v_dt * Accum(mass[i]);
+					twiceKineticDt2 += dot(mv_dt, v_dt);
+					momentumDt += mv_dt;
+					chunkMass += Accum(mass[i]);
+					massHeight += Accum(mass[i]) * p.y;
+				}
+
+				// applyForces leaves nodes resting on the floor with their contact force
+				accum_type f = p.y + pos.y > 0 ? accum_type(GRAVITY) * Accum(mass[i]) : accum_type(force[i]);
+
+				if (driven[i]) {
+					accum_type drag = -Accum(INPUT_FRICTION) * v_dt * invDt * Accum(mass[i]);
+					f += accum_type(inputForce) + accum_type(drag.x, 0, drag.z);
+				}
+
+				if (gather) {
+					f += gatherSpringForce(topo, i, position, previous, invDt, measure ? &gatherEnergy : nullptr);
+				} else {
+					f += accum[i];
+					accum[i] = accum_type(0);
+				}
+
+				accum_type nextPos = p + v_dt + f * Accum(invMass[i]) * dt2;
+				if (nextPos.y + pos.y < floorY) {
+					nextPos.y = floorY - pos.y;
+					f = accum_type(0, -9.8f, 0.0);
+				}
+
+				force[i] = vec_type(f);
+				if (!gather) {
+					previous[i] = vec_type(p);
+				}
+				next[i] = vec_type(nextPos);
+			}
+
+			CageStats partial;
+			partial.kinetic = 0.5 * double(twiceKineticDt2) * double(invDt) * double(invDt);
+			partial.momentum = dvec3(momentumDt) * double(invDt);
+			partial.gravitational = -double(GRAVITY.y) * (double(massHeight) + double(chunkMass) * pos.y);
+			partial.springPotential = gatherEnergy.potential;
+			partial.maxStrain = gatherEnergy.maxStrain;
+			return partial;
+		};
+
+		if (measure) {
+			stats = ThreadPool::shared().parallelReduce(0, n, NODE_BATCH_GRAIN, CageStats(), nodePass, mergeStats);
+			if (!gather) {
+				stats.springPotential = scatterEnergy.potential;
+				stats.maxStrain = scatterEnergy.maxStrain;
+			}
+		} else {
+			ThreadPool::shared().parallelFor(0, n, NODE_BATCH_GRAIN, [&](size_t begin, size_t end) {
+				nodePass(begin, end);
+			});
+		}
+
+		if (gather) {
+			// previous <- position <- next, the old previous array becomes the next scratch buffer
+			pts.previous.swap(pts.position);
+			pts.position.swap(nextPosition);
+		}
+	}
+
+	vec3 readInputForce(GLFWwindow* window) {
 			vec3 inputForce = vec3(0.0f);
-			float forceStrength = 19.81f; // Adjust this value
+			float forceStrength = INPUT_STRENGTH;
 
 			// Check inputs and accumulate forces
 			if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
@@ -113,15 +654,23 @@ class Cage {
 				inputForce.y += 9.81f  * 3;
 			}
 
-			float friction = 15.0f;
-			auto start = pts.begin();
-			while (start != pts.end()  - (pts.size() / 2)) {
-				PointMass &pointMass = *start;
-				vec3 velocity = (pointMass.Position - pointMass.previousPosition)/dt;
-				auto temp = pointMass.forces;
-				pointMass.forces += inputForce + (-friction * velocity * pointMass.mass);
-				pointMass.forces.y = temp.y + inputForce.y;
-				++start;
+			return inputForce;
+	}
+
+	void applyUserInput(GLFWwindow* window, float dt) {
+			applyUserInput(readInputForce(window), dt);
+	}
+
+	void applyUserInput(vec3 inputForce, float dt) {
+			float friction = INPUT_FRICTION;
+			for (size_t i = 0; i < pts.size(); ++i) {
+				if (!driven[i]) {
+					continue;
+				}
+				vec_type velocity = (pts.position[i] - pts.previous[i]) / Real(dt);
+				auto temp = pts.force[i];
+				pts.force[i] += vec_type(inputForce) + (-Real(friction) * velocity * pts.mass[i]);
+				pts.force[i].y = temp.y + inputForce.y;
 			}
 
 			// while (start != pts.end() - 5) {
@@ -141,17 +690,17 @@ class Cage {
 		}
 
 		void appendForces(vec3 force) {
-			for (auto &pointMass : pts) {
-				pointMass.forces = force;
+			for (auto &f : pts.force) {
+				f = vec_type(force);
 			}
 		}
 
 
 		void satisfyConstraints(float floorY) {
-			for (auto &p : pts) {
-				if (p.Position.y + pos.y < floorY) {
-					p.Position.y = floorY - pos.y;
-					p.forces = vec3(0, -9.8f, 0.0);
+			for (size_t i = 0; i < pts.size(); ++i) {
+				if (pts.position[i].y + pos.y < floorY) {
+					pts.position[i].y = floorY - pos.y;
+					pts.force[i] = vec_type(0, -9.8f, 0.0);
 
 				}
 			}
@@ -159,143 +708,211 @@ class Cage {
 
 
 		void applyForces(vec3 gravity) {
-			for (auto &pointMass : pts) {
-				if (pointMass.Position.y + pos.y > 0) {
-					pointMass.forces = gravity * pointMass.mass;
+			for (size_t i = 0; i < pts.size(); ++i) {
+				if (pts.position[i].y + pos.y > 0) {
+					pts.force[i] = vec_type(gravity) * pts.mass[i];
 				}
 			}
 		}
 
 		void springCorrectionForces(float deltaTime) {
-			for (auto &spring : springs) {
-				PointMass *pm_a = &pts[spring.v0];
-				PointMass *pm_b = &pts[spring.v1];
-
-				// Vector pointing from one point to the other
-				vec3 ab = pm_a->Position - pm_b->Position;
-
-				// Magnitude of pm_a and pm_b
-				float m_ab = length(ab);
-
-				// Compute the force as the
-				// Spring damping coefficient times the difference of the magnitude of pa-pb and spring rest length
-				float force_elastic = spring.k * (m_ab - spring.restLength);
-				vec3 force_dir = normalize(ab);
-				vec3 f_a = -force_elastic * force_dir;
-
-				pm_a->forces += f_a;
-				pm_b->forces -= f_a;
-
-				vec3 vA = (pm_a->Position - pm_a->previousPosition) / deltaTime;
-				vec3 vB = (pm_b->Position - pm_b->previousPosition) / deltaTime;
-
-				vec3 vDiff = vA - vB;
-
-				vec3 force_damping = -spring.kd * dot(vDiff, ab) / length(ab) * normalize(ab);
-				//cout << "spring force " << force << "N" << endl;
+			const Real invDt = Real(1) / Real(deltaTime);
+
+			if (forceEvaluation == GATHER_FORCES) {
+				const vec_type* position = pts.position.data();
+				const vec_type* previous = pts.previous.data();
+				vec_type* force = pts.force.data();
+				ThreadPool::shared().parallelFor(0, pts.size(), NODE_BATCH_GRAIN, [&](size_t begin, size_t end) {
+					springForcesGather(shape->topo, begin, end, position, previous, force, invDt);
+				});
+				return;
+			}
 
-				// float criticalDamping = 2.0f * sqrt(spring.k * (pm_a->mass + pm_b->mass) / 2.0f);
-				// vec3 force_damping = -criticalDamping * relativeVelAlongSpring * force_dir;\
+			scatterSpringForces(pts.force.data(), invDt);
+		}
 
-				pm_a->forces += force_damping;
-				pm_b->forces -= force_damping;
+		// adds every spring's force into target, color by color, worked out in A. with energy set
+		// the blocks go one at a time, each into its own slot, and are summed in block order
+		template <typename A>
+		void scatterSpringForces(vec<3, A>* target, A invDt, SpringEnergy* energy = nullptr) {
+			const vec_type* position = pts.position.data();
+			const vec_type* previous = pts.previous.data();
+			const SpringKernel kernel = springKernel;
+			const CageTopology& topo = shape->topo;
+
+			auto batch = [&](size_t begin, size_t end, SpringEnergy* e) {
+				if constexpr (P::realTime) {
+					if (kernel == SIMD_KERNEL) {
+						springForcesSimd(topo, begin, end, position, previous, target, invDt, e);
+						return;
+					}
+				}
+				springForcesScalar(topo, begin, end, position, previous, target, invDt, e);
+			};
+
+			if (energy) {
+				blockEnergy.assign(topo.numBlocks(), SpringEnergy());
+				forEachSpringBlock(topo, [&](size_t begin, size_t end) {
+					size_t b = lower_bound(topo.blockOffsets.begin(), topo.blockOffsets.end(), begin) - topo.blockOffsets.begin();
+					batch(begin, end, &blockEnergy[b]);
+				});
+				for (const auto& e : blockEnergy) {
+					energy->potential += e.potential;
+					energy->maxStrain = std::max(energy->maxStrain, e.maxStrain);
+				}
+				return;
+			}
+			auto plain = [&](size_t begin, size_t end) {
+				batch(begin, end, nullptr);
+			};
+			if (deterministic) {
+				forEachSpringBlock(topo, plain);
+			} else {
+				forEachSpringBatch(topo, plain);
 			}
 		}
 
-		void friction(float deltaTime, float dampening_coefff) {
-			for (auto &spring : springs) {
-				PointMass *pm_a = &pts[spring.v0];
-				PointMass *pm_b = &pts[spring.v1];
+		void friction(Real deltaTime, Real dampening_coefff) {
+			vec_type* position = pts.position.data();
+			vec_type* previous = pts.previous.data();
+			vec_type* force = pts.force.data();
 
-				vec3 ab = pm_a->Position - pm_b->Position;
-				float m_ab = length(ab);
+			for (auto &spring : shape->springs) {
+				const unsigned int a = spring.v0;
+				const unsigned int b = spring.v1;
+
+				vec_type ab = position[a] - position[b];
+				Real m_ab = length(ab);
 
 				if (m_ab < 1e-6f) continue;
-				vec3 force_dir = ab / m_ab; // normalize
+				vec_type force_dir = ab / m_ab; // normalize
 
 				// Calculate relative velocity
-				vec3 vA = (pm_a->Position - pm_a->previousPosition) / deltaTime;
-				vec3 vB = (pm_b->Position - pm_b->previousPosition) / deltaTime;
-				vec3 relativeVel = vA - vB;
+				vec_type vA = (position[a] - previous[a]) / deltaTime;
+				vec_type vB = (position[b] - previous[b]) / deltaTime;
+				vec_type relativeVel = vA - vB;
 
-				float velAlongSpring = dot(relativeVel, force_dir);
-				vec3 dampingForce = -dampening_coefff * velAlongSpring * force_dir;
+				Real velAlongSpring = dot(relativeVel, force_dir);
+				vec_type dampingForce = -dampening_coefff * velAlongSpring * force_dir;
 
-				vec3 velPerpToSpring = relativeVel - velAlongSpring * force_dir;
+				vec_type velPerpToSpring = relativeVel - velAlongSpring * force_dir;
 
-				vec3 shearDamping = -dampening_coefff * 0.5f * velPerpToSpring;
+				vec_type shearDamping = -dampening_coefff * Real(0.5f) * velPerpToSpring;
 
-				vec3 totalDamping = dampingForce + shearDamping;
+				vec_type totalDamping = dampingForce + shearDamping;
 
-				pm_a->forces += totalDamping;
-				pm_b->forces -= totalDamping;
+				force[a] += totalDamping;
+				force[b] -= totalDamping;
 			}
 		}
 
-		void verletStep(float deltaTime, float damping) {
+		void verletStep(Real deltaTime, Real damping) {
 
-			for (auto &point_mass : pts) {
-				vec3 accel = point_mass.forces / point_mass.mass;
+			for (size_t i = 0; i < pts.size(); ++i) {
+				vec_type accel = pts.force[i] * pts.invMass[i];
 
-				vec3 v_dt = point_mass.Position - point_mass.previousPosition;
+				vec_type v_dt = pts.position[i] - pts.previous[i];
 
-				vec3 nextPos = point_mass.Position
+				vec_type nextPos = pts.position[i]
 								+ (v_dt)
 								+ accel * deltaTime * deltaTime;
 
-				if (&point_mass == &pts[1]) {
-					cout << "force: (" << point_mass.forces.x << ", "
-						<< point_mass.forces.y << ", "
-						<< point_mass.forces.z << ") | ";
-					cout << "a = (" << accel.x << ", " << accel.y << ", " << accel.z << ") | ";
-					cout << "t = " << glfwGetTime() << " | ";
-					cout << "("
-						<< point_mass.Position.x + pos.x << ", "
-						<< point_mass.Position.y + pos.y << ", "
-						<< point_mass.Position.z + pos.z << ")";
-					cout << " -> (" << nextPos.x + pos.x <<
-						", " << nextPos.y + pos.y <<
-						", " << nextPos.z + pos.z << ") | ";
-					cout << "v dt = (" << v_dt.x << ", " << v_dt.y << ", " << v_dt.z << ")" << endl;
-				}
-
-				point_mass.previousPosition = point_mass.Position;
-				point_mass.Position = nextPos;
+				pts.previous[i] = pts.position[i];
+				pts.position[i] = nextPos;
 			}
 		}
 
 		void springConstrain() {
-			const float minDist = 0.01;
+			const Real minDist = 0.01;
 
-			for (auto &spring : springs) {
-				const float maxDist = 1.1f * spring.restLength;
+			vec_type* position = pts.position.data();
 
-				PointMass *pm_a = &pts[spring.v0];
-				PointMass *pm_b = &pts[spring.v1];
+			for (auto &spring : shape->springs) {
+				const Real maxDist = Real(1.1f) * spring.restLength;
+
+				vec_type &p_a = position[spring.v0];
+				vec_type &p_b = position[spring.v1];
 
 				// Euclidean distance
-				const float distance = glm::distance(pm_a->Position, pm_b->Position);
-				vec3 ab_norm(0.0f, 1.0f, 0.0f);
+				const Real distance = glm::distance(p_a, p_b);
+				vec_type ab_norm(0.0f, 1.0f, 0.0f);
 
 				if (distance < minDist) {
-					float diff = (minDist - distance);
-					pm_a->Position -= 0.5f * diff * ab_norm;
-					pm_b->Position += 0.5f * diff * ab_norm;
+					Real diff = (minDist - distance);
+					p_a -= Real(0.5f) * diff * ab_norm;
+					p_b += Real(0.5f) * diff * ab_norm;
 				}
 
 				if (distance > maxDist) {
-					float diff = (distance - maxDist);
-					vec3 delta = normalize(pm_b->Position - pm_a->Position);
+					Real diff = (distance - maxDist);
+					vec_type delta = normalize(p_b - p_a);
 					// cout << "spring " << diff << "too long | rest length " << spring.restLength << " | actual length " << distance << endl;
-					pm_a->Position += delta * 0.5f * diff;
-					pm_b->Position -=  delta * 0.5f * diff;
+					p_a += delta * Real(0.5f) * diff;
+					p_b -=  delta * Real(0.5f) * diff;
 				}
 			}
 		}
 
         void refreshMesh() {
-            setupMesh();
+			if constexpr (is_same<Real, float>::value) {
+				setupMesh(pts.position.data());
+			} else {
+				// the vertex buffer is always float
+				renderPosition.assign(pts.position.begin(), pts.position.end());
+				setupMesh(renderPosition.data());
+			}
         }
+
+		// uploads the nodes alpha of the way from the start of the last tick to now
+		void refreshMesh(float alpha) {
+			stageMesh(alpha);
+			uploadMesh();
+		}
+
+		// the cpu half of refreshMesh(alpha), fills the vertex staging buffer. touches no gl state,
+		// so it can run on any thread
+		void stageMesh(float alpha) {
+			staged = true;
+			bool current = tickStart.size() != pts.size();
+			if (sleepMonitor.asleep) {
+				// the pose doesn't change while asleep, upload it once
+				staged = !restUploaded;
+				restUploaded = true;
+				current = true;
+			}
+			if (!staged) {
+				return;
+			}
+			renderPosition.resize(pts.size());
+			for (size_t i = 0; i < pts.size(); ++i) {
+				renderPosition[i] = current ? vec3(pts.position[i]) : vec3(mix(tickStart[i], pts.position[i], Real(alpha)));
+			}
+		}
+
+		// the gl half, sends what stageMesh staged. main thread only
+		void uploadMesh() {
+			if (staged) {
+				setupMesh(renderPosition.data());
+				staged = false;
+			}
+		}
+
+		// sends vertices, one per node, in place of the cage's own. for a renderer drawing from a
+		// snapshot while another thread steps the cage: this and Draw only read the shape
+		void uploadMesh(const vec3* vertices) {
+			setupMesh(vertices);
+		}
+
+		// the nodes at the start of the last tick and now, for a snapshot. start is a copy of end
+		// before the first tick
+		void copyTick(vector<vec3>& start, vector<vec3>& end) const {
+			end.assign(pts.position.begin(), pts.position.end());
+			if (tickStart.size() == pts.size()) {
+				start.assign(tickStart.begin(), tickStart.end());
+			} else {
+				start = end;
+			}
+		}
 		
 		void Draw(Shader& massShader, Shader& lineShader)
 		{
@@ -313,58 +930,82 @@ class Cage {
 			// draw mesh
 			glBindVertexArray(VAO);
 			glPointSize(15.0f);
-			glDrawArrays(GL_POINTS, 0, pts.size());
+			glDrawArrays(GL_POINTS, 0, shape->numNodes());
 		}
 
 		void DrawSprings() {
 			// draw lines ?
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-			glDrawElements(GL_LINES, idx.size(), GL_UNSIGNED_INT, 0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape->indexBuffer());
+			glDrawElements(GL_LINES, shape->numIndices(), GL_UNSIGNED_INT, 0);
 
 			glBindVertexArray(0);
 		}
 
 	private:
-		unsigned int VAO, VBO, EBO;
-        vector<unsigned int> idx;
-
-		void setupMesh() {
-			glGenVertexArrays(1, &VAO);
-			glGenBuffers(1, &VBO);
-			glGenBuffers(1, &EBO);
-
-            // build idx buffer
-            idx.clear();
-            for (auto& s : springs) {
-                idx.push_back(s.v0);
-                idx.push_back(s.v1);
-            }
+		unsigned int VAO = 0, VBO = 0;
+		// the vertex array only picks up the shape's index buffer again after setShape
+		bool indicesDirty = true;
+		// positions at the start of the last tick, and the blend refreshMesh(alpha) uploads
+		// the step the current velocities were taken over, 0 before the first
+		float lastStepDt = 0.0f;
+		// arrow key input for the tick, whether the tick runs at all, and the mode of the step
+		// whose phases are under way
+		vec3 stepInput = vec3(0.0f);
+		bool tickActive = false;
+		StepMode phaseMode = FUSED_STEP;
+		// spring energy of the fused scatter pass, while collectStats is on
+		SpringEnergy scatterEnergy;
+		int lastSubsteps = 1;
+		// whether the rest pose has gone to the gpu since the cage fell asleep
+		bool restUploaded = false;
+		// whether renderPosition holds vertices uploadMesh hasn't sent yet
+		bool staged = false;
+
+		aligned_vector<vec_type> tickStart;
+		aligned_vector<vec3> renderPosition;
+		// scratch buffers for fusedStep, spring forces (scatter) or new positions (gather)
+		aligned_vector<accum_type> springAccum;
+		aligned_vector<vec_type> nextPosition;
+		// per block spring energy while collectStats is on
+		vector<SpringEnergy> blockEnergy;
+
+		// buffers are created on the first call and refilled after, the vertices go up every frame
+		void setupMesh(const vec3* vertices) {
+			if (VAO == 0) {
+				glGenVertexArrays(1, &VAO);
+				glGenBuffers(1, &VBO);
+			}
 
 			// bind pointmass vertex data
 			glBindVertexArray(VAO);
 			glBindBuffer(GL_ARRAY_BUFFER, VBO);
-			glBufferData(GL_ARRAY_BUFFER, pts.size() * sizeof(PointMass), &pts[0], GL_STATIC_DRAW);
+			glBufferData(GL_ARRAY_BUFFER, shape->numNodes() * sizeof(vec3), vertices, GL_DYNAMIC_DRAW);
 
-			// bind ebo spring data 
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned int),
-				&idx[0], GL_STATIC_DRAW);
+			if (indicesDirty) {
+				// bind the shared ebo spring data, uploaded once per shape
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape->indexBuffer());
+				indicesDirty = false;
+			}
 
 			// positions
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PointMass), (void*)0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
 			glEnableVertexAttribArray(0);
 			// weight
 			
-			glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(PointMass), (void*)offsetof(PointMass, Position));
+			glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
 			glEnableVertexAttribArray(1);
 
 			glBindVertexArray(0);
 		}
 };
 
-class Cube : public Cage {
+// the real time cage every scene used before precision became a parameter
+typedef BasicCage<FloatPrecision> Cage;
+
+template <typename P>
+class BasicCube : public BasicCage<P> {
 	public:
-		Cube(unsigned int length = 1, unsigned int npl = 1, vec3 pos = vec3(0.0f, 0.0f, 0.0f)) {
+		BasicCube(unsigned int length = 1, unsigned int npl = 1, vec3 pos = vec3(0.0f, 0.0f, 0.0f)) {
 			if (npl == 0) {
 				cout << "ERROR::CUBE::INVALID_NPL" << endl;
 				return;
@@ -383,7 +1024,6 @@ class Cube : public Cage {
 
 		void construct() {
 			vector<PointMass> nodes;
-			vector<Spring> springs;
 
 			float start = -length / 2.0f;
 			int nodesPerEdge = length * nodesPerLength + 1;
@@ -394,6 +1034,65 @@ class Cube : public Cage {
 						nodes.push_back(PointMass(vec3(start + ((float)i / nodesPerLength),
 										start + ((float)j / nodesPerLength),
 										start + ((float)k / nodesPerLength)), 1));
+					}
+				}
+			}
+
+			//for (auto& node : nodes) {
+			//	cout << "pt at " << node.Position.x << ", " << node.Position.y << ", " << node.Position.z << endl;
+			//}
+			//cout << endl;
+
+			shared_ptr<const CageShape> shape = cubeShape(length, nodesPerLength);
+
+			// the edge, shear, body and bend springs together are about as stiff along an axis as a
+			// solid with these moduli, so FEM_STEP behaves like the springs did
+			this->femSolver.youngsModulus = 6.0f * shape->springs[0].k / shape->grid.spacing;
+			this->femSolver.damping = 4.0f * shape->springs[0].kd / shape->grid.spacing;
+
+			this->pts.assign(nodes);
+			this->resetDrivenNodes();
+			this->setShape(shape);
+			
+			this->refreshMesh();
+		}
+
+		// every cube of one length and nodes per length has the same springs, they're built by the
+		// first and shared by the rest for as long as any of them is around
+		static shared_ptr<const CageShape> cubeShape(int length, int nodesPerLength) {
+			static mutex lock;
+			static map<pair<int, int>, weak_ptr<const CageShape>> built;
+
+			lock_guard<mutex> guard(lock);
+			const pair<int, int> key = make_pair(length, nodesPerLength);
+			auto found = built.find(key);
+			if (found != built.end()) {
+				if (auto shape = found->second.lock()) {
+					return shape;
+				}
+			}
+
+			// drop the sizes nobody uses anymore before adding this one
+			for (auto it = built.begin(); it != built.end();) {
+				it = it->second.expired() ? built.erase(it) : next(it);
+			}
+			shared_ptr<const CageShape> shape = buildShape(length, nodesPerLength);
+			built[key] = shape;
+			return shape;
+		}
+
+		static shared_ptr<const CageShape> buildShape(int length, int nodesPerLength) {
+			vector<Spring> springs;
+			NodeGrid grid;
+
+			int nodesPerEdge = length * nodesPerLength + 1;
+			grid.dims = ivec3(nodesPerEdge);
+			grid.spacing = (float) length / (nodesPerEdge - 1);
+
+			for (int i = 0; i < nodesPerEdge; ++i) {
+				for (int j = 0; j < nodesPerEdge; ++j) {
+					for (int k = 0; k < nodesPerEdge; ++k) {
+						grid.coord.push_back(ivec3(i, j, k));
 						
 						bool isTopZ = (k + 1 == nodesPerEdge);
 						bool isTopX = (i + 1 == nodesPerEdge);
@@ -508,16 +1207,13 @@ class Cube : public Cage {
 				}
 			}
 
-			//for (auto& node : nodes) {
-			//	cout << "pt at " << node.Position.x << ", " << node.Position.y << ", " << node.Position.z << endl;
-			//}
-			//cout << endl;
-
-			this->pts = nodes;
-			this->springs = springs;
-			
-			refreshMesh();
+			size_t numNodes = grid.coord.size();
+			return make_shared<CageShape>(move(springs), numNodes, move(grid));
 		}
 };
 
+typedef BasicCube<FloatPrecision> Cube;
+typedef BasicCube<DoublePrecision> DoubleCube;
+typedef BasicCube<MixedPrecision> MixedCube;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,362 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+#include "cage.h"
+#include "threadpool.h"
+
+// two surface nodes of different cages closer than the contact distance, cageA < cageB
+struct ContactCandidate {
+	unsigned int cageA;
+	unsigned int nodeA;
+	unsigned int cageB;
+	unsigned int nodeB;
+};
+
+// surface nodes per chunk of the hash query
+const size_t CONTACT_GRAIN = 1024;
+
+// keeps cages from passing through each other. findCandidates first drops every cage whose
+// bounding box touches no other, or only sleeping ones: the boxes go into a coarse hash of cells as
+// wide as the largest box and only boxes that share a cell are compared. the surface
+// nodes of the cages left go into a spatial hash of cells distance wide, rebuilt every tick with a
+// counting sort in O(nodes), and every node looks for nodes of other cages in the 27 cells around
+// its own. the query runs on the thread pool in fixed chunks whose results are joined in order, so
+// the candidates come out the same for any thread count. resolve then pushes each pair apart to
+// distance, in candidate order, the way satisfyConstraints pushes nodes out of the floor
+class CageContacts {
+	public:
+		// surface nodes of different cages are kept this far apart. about the node spacing of the
+		// cages, much less and nodes slip through the gaps between the other cage's nodes
+		float distance = 0.25f;
+		// a sleeping cage only gives way, and wakes up, to pushes deeper than this. shallower ones it
+		// takes like the floor, so cages resting on each other can fall asleep
+		float wakeDistance = 1e-3f;
+
+		// from the last findCandidates
+		vector<ContactCandidate> candidates;
+
+		// findCandidates then resolve. between ticks only, the cages mustn't be stepping
+		size_t update(const vector<Cage*>& cages, ThreadPool& pool = ThreadPool::shared()) {
+			findCandidates(cages, pool);
+			return resolve(cages);
+		}
+
+		void findCandidates(const vector<Cage*>& cages, ThreadPool& pool = ThreadPool::shared()) {
+			candidates.clear();
+			measureBounds(cages, pool);
+			if (!cullBounds(cages.size())) {
+				items.clear();
+				return;
+			}
+			buildHash(cages, pool);
+			query(pool);
+		}
+
+		// pushes every candidate pair still closer than distance apart along the line between
+		// them, split by inverse mass. returns the pairs pushed
+		size_t resolve(const vector<Cage*>& cages) {
+			const float distance2 = distance * distance;
+			size_t pushed = 0;
+			for (auto& c : candidates) {
+				Cage& a = *cages[c.cageA];
+				Cage& b = *cages[c.cageB];
+				vec3 d = (a.pts.position[c.nodeA] + a.pos) - (b.pts.position[c.nodeB] + b.pos);
+				float len2 = dot(d, d);
+				if (len2 >= distance2 || len2 == 0.0f) {
+					continue;
+				}
+
+				float len = sqrt(len2);
+				float depth = distance - len;
+				float wa = giveWay(a, depth) ? a.pts.invMass[c.nodeA] : 0.0f;
+				float wb = giveWay(b, depth) ? b.pts.invMass[c.nodeB] : 0.0f;
+				if (wa + wb == 0.0f) {
+					continue;
+				}
+
+				vec3 push = d * (depth / (len * (wa + wb)));
+				a.pts.position[c.nodeA] += push * wa;
+				b.pts.position[c.nodeB] -= push * wb;
+				++pushed;
+			}
+			return pushed;
+		}
+
+		// surface nodes that went into the hash last time
+		size_t numItems() const {
+			return items.size();
+		}
+
+	private:
+		struct Bounds {
+			vec3 lo;
+			vec3 hi;
+			bool asleep;
+		};
+
+		struct Item {
+			vec3 position;
+			ivec3 cell;
+			unsigned int cage;
+			unsigned int node;
+		};
+
+		// a cell a box covers, in cells boxCell wide
+		struct BoxItem {
+			ivec3 cell;
+			unsigned int cage;
+		};
+
+		vector<Bounds> bounds;
+		float boxCell = 1.0f;
+		vector<BoxItem> boxItems;
+		vector<unsigned int> boxBucket;
+		// box items sorted by bucket, bucket b holds sortedBoxes[boxStart[b], boxStart[b + 1])
+		vector<BoxItem> sortedBoxes;
+		vector<unsigned int> boxStart;
+		// 1 for the cages whose surface goes into the hash
+		vector<unsigned char> active;
+		// index of each cage's first item, of the active ones
+		vector<size_t> firstItem;
+
+		vector<Item> items;
+		vector<unsigned int> itemBucket;
+		// items sorted by bucket, bucket b holds sorted[bucketStart[b], bucketStart[b + 1])
+		vector<Item> sorted;
+		vector<unsigned int> bucketStart;
+		vector<unsigned int> bucketFill;
+		unsigned int bucketMask = 0;
+		// candidates of each query chunk, kept around for their capacity
+		vector<vector<ContactCandidate>> partial;
+
+		// true when the cage may be moved by a push depth deep, waking it if it sleeps
+		bool giveWay(Cage& cage, float depth) {
+			if (!cage.sleepMonitor.asleep) {
+				return true;
+			}
+			if (depth <= wakeDistance) {
+				return false;
+			}
+			cage.wake();
+			return true;
+		}
+
+		ivec3 cellOf(vec3 p) const {
+			return ivec3(floor(p / distance));
+		}
+
+		static unsigned int hashCell(ivec3 cell) {
+			return (unsigned int)cell.x * 73856093u ^ (unsigned int)cell.y * 19349663u ^ (unsigned int)cell.z * 83492791u;
+		}
+
+		unsigned int bucketOf(ivec3 cell) const {
+			return hashCell(cell) & bucketMask;
+		}
+
+		ivec3 boxCellOf(vec3 p) const {
+			return ivec3(floor(p / boxCell));
+		}
+
+		// every cage's surface box in world space, grown by half the contact distance on every side
+		void measureBounds(const vector<Cage*>& cages, ThreadPool& pool) {
+			bounds.resize(cages.size());
+			const float margin = 0.5f * distance;
+			pool.parallelFor(0, cages.size(), 8, [&](size_t begin, size_t end) {
+				for (size_t c = begin; c < end; ++c) {
+					const Cage& cage = *cages[c];
+					Bounds& b = bounds[c];
+					b.lo = vec3(INFINITY);
+					b.hi = vec3(-INFINITY);
+					for (unsigned int i : cage.shape->surface) {
+						b.lo = glm::min(b.lo, cage.pts.position[i]);
+						b.hi = glm::max(b.hi, cage.pts.position[i]);
+					}
+					b.lo += cage.pos - margin;
+					b.hi += cage.pos + margin;
+					b.asleep = cage.sleepMonitor.asleep;
+				}
+			});
+		}
+
+		// marks the cages whose box overlaps another's, one of the two awake. false when there are none.
+		// with cells as wide as the largest box every box covers at most 2 cells a side, so cages
+		// spread over a floor or stacked in a column cost O(cages) alike
+		bool cullBounds(size_t numCages) {
+			active.assign(numCages, 0);
+			boxCell = distance;
+			for (const Bounds& b : bounds) {
+				if (b.lo.x <= b.hi.x) {
+					vec3 size = b.hi - b.lo;
+					boxCell = std::max(boxCell, std::max(size.x, std::max(size.y, size.z)));
+				}
+			}
+
+			boxItems.clear();
+			for (size_t c = 0; c < numCages; ++c) {
+				const Bounds& b = bounds[c];
+				// cages without surface nodes have an empty box
+				if (b.lo.x > b.hi.x) {
+					continue;
+				}
+				ivec3 lo = boxCellOf(b.lo);
+				ivec3 hi = boxCellOf(b.hi);
+				for (int x = lo.x; x <= hi.x; ++x) {
+					for (int y = lo.y; y <= hi.y; ++y) {
+						for (int z = lo.z; z <= hi.z; ++z) {
+							boxItems.push_back(BoxItem{ ivec3(x, y, z), (unsigned int)c });
+						}
+					}
+				}
+			}
+
+			// the same counting sort as buildHash, stable so each bucket keeps cage order
+			const size_t n = boxItems.size();
+			unsigned int numBuckets = 1;
+			while (numBuckets < 2 * n) {
+				numBuckets <<= 1;
+			}
+			boxBucket.resize(n);
+			boxStart.assign(numBuckets + 1, 0);
+			for (size_t i = 0; i < n; ++i) {
+				boxBucket[i] = hashCell(boxItems[i].cell) & (numBuckets - 1);
+				++boxStart[boxBucket[i] + 1];
+			}
+			for (unsigned int b = 0; b < numBuckets; ++b) {
+				boxStart[b + 1] += boxStart[b];
+			}
+			bucketFill.assign(boxStart.begin(), boxStart.end() - 1);
+			sortedBoxes.resize(n);
+			for (size_t i = 0; i < n; ++i) {
+				sortedBoxes[bucketFill[boxBucket[i]]++] = boxItems[i];
+			}
+
+			bool any = false;
+			for (unsigned int bucket = 0; bucket < numBuckets; ++bucket) {
+				for (unsigned int i = boxStart[bucket]; i < boxStart[bucket + 1]; ++i) {
+					const BoxItem& p = sortedBoxes[i];
+					const Bounds& a = bounds[p.cage];
+					for (unsigned int j = i + 1; j < boxStart[bucket + 1]; ++j) {
+						const BoxItem& q = sortedBoxes[j];
+						const Bounds& b = bounds[q.cage];
+						// boxes sharing several cells meet in each, once both are marked there's nothing to add
+						if (q.cell != p.cell || (a.asleep && b.asleep) || (active[p.cage] && active[q.cage])) {
+							continue;
+						}
+						if (b.lo.x > a.hi.x || a.lo.x > b.hi.x || b.lo.y > a.hi.y || a.lo.y > b.hi.y || b.lo.z > a.hi.z || a.lo.z > b.hi.z) {
+							continue;
+						}
+						active[p.cage] = 1;
+						active[q.cage] = 1;
+						any = true;
+					}
+				}
+			}
+			return any;
+		}
+
+		void buildHash(const vector<Cage*>& cages, ThreadPool& pool) {
+			firstItem.resize(cages.size());
+			size_t n = 0;
+			for (size_t c = 0; c < cages.size(); ++c) {
+				firstItem[c] = n;
+				if (active[c]) {
+					n += cages[c]->shape->surface.size();
+				}
+			}
+
+			// at least twice as many buckets as items keeps the buckets short
+			unsigned int numBuckets = 1;
+			while (numBuckets < 2 * n) {
+				numBuckets <<= 1;
+			}
+			bucketMask = numBuckets - 1;
+
+			items.resize(n);
+			itemBucket.resize(n);
+			pool.parallelFor(0, cages.size(), 8, [&](size_t begin, size_t end) {
+				for (size_t c = begin; c < end; ++c) {
+					if (!active[c]) {
+						continue;
+					}
+					const Cage& cage = *cages[c];
+					const vector<unsigned int>& surface = cage.shape->surface;
+					for (size_t s = 0; s < surface.size(); ++s) {
+						Item& item = items[firstItem[c] + s];
+						item.position = cage.pts.position[surface[s]] + cage.pos;
+						item.cell = cellOf(item.position);
+						item.cage = (unsigned int)c;
+						item.node = surface[s];
+						itemBucket[firstItem[c] + s] = bucketOf(item.cell);
+					}
+				}
+			});
+
+			// counting sort by bucket, stable so the order within a bucket is the items' order
+			bucketStart.assign(numBuckets + 1, 0);
+			for (size_t i = 0; i < n; ++i) {
+				++bucketStart[itemBucket[i] + 1];
+			}
+			for (unsigned int b = 0; b < numBuckets; ++b) {
+				bucketStart[b + 1] += bucketStart[b];
+			}
+			bucketFill.assign(bucketStart.begin(), bucketStart.end() - 1);
+			sorted.resize(n);
+			for (size_t i = 0; i < n; ++i) {
+				sorted[bucketFill[itemBucket[i]]++] = items[i];
+			}
+		}
+
+		// every pair of sorted items of different cages, not both asleep, closer than distance.
+		// item k reports the pairs it has with the items after it
+		void query(ThreadPool& pool) {
+			const float distance2 = distance * distance;
+			const size_t n = sorted.size();
+			const size_t numChunks = (n + CONTACT_GRAIN - 1) / CONTACT_GRAIN;
+			partial.resize(std::max(partial.size(), numChunks));
+
+			pool.parallelFor(0, numChunks, 1, [&](size_t first, size_t last) {
+				for (size_t chunk = first; chunk < last; ++chunk) {
+					vector<ContactCandidate>& out = partial[chunk];
+					out.clear();
+					for (size_t k = chunk * CONTACT_GRAIN; k < std::min(n, (chunk + 1) * CONTACT_GRAIN); ++k) {
+						const Item& a = sorted[k];
+						for (int dx = -1; dx <= 1; ++dx) {
+							for (int dy = -1; dy <= 1; ++dy) {
+								for (int dz = -1; dz <= 1; ++dz) {
+									ivec3 cell = a.cell + ivec3(dx, dy, dz);
+									unsigned int b = bucketOf(cell);
+									for (unsigned int j = std::max(bucketStart[b], (unsigned int)k + 1); j < bucketStart[b + 1]; ++j) {
+										const Item& o = sorted[j];
+										// cells that share a bucket would report o once for each
+										if (o.cage == a.cage || o.cell != cell || (bounds[a.cage].asleep && bounds[o.cage].asleep)) {
+											continue;
+										}
+										vec3 d = a.position - o.position;
+										if (dot(d, d) < distance2) {
+											out.push_back(a.cage < o.cage ? ContactCandidate{ a.cage, a.node, o.cage, o.node }
+																		  : ContactCandidate{ o.cage, o.node, a.cage, a.node });
+										}
+									}
+								}
+							}
+						}
+					}
+				}
+			});
+
+			for (size_t chunk = 0; chunk < numChunks; ++chunk) {
+				candidates.insert(candidates.end(), partial[chunk].begin(), partial[chunk].end());
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// energy and momentum of a cage at the start of its last step. velocities are the verlet ones,
+// (position - previous) / dt, and gravitational energy is measured from y = 0 in world space
+struct CageStats {
+	double kinetic = 0.0;
+	// elastic energy, of the tets under FEM_STEP
+	double springPotential = 0.0;
+	double gravitational = 0.0;
+	dvec3 momentum = dvec3(0.0);
+	// largest |length - rest| / rest over the springs
+	float maxStrain = 0.0f;
+
+	double total() const {
+		return kinetic + springPotential + gravitational;
+	}
+};
+
+// folds the stats of two disjoint sets of nodes and springs
+inline CageStats mergeStats(const CageStats& a, const CageStats& b) {
+	CageStats s;
+	s.kinetic = a.kinetic + b.kinetic;
+	s.springPotential = a.springPotential + b.springPotential;
+	s.gravitational = a.gravitational + b.gravitational;
+	s.momentum = a.momentum + b.momentum;
+	s.maxStrain = std::max(a.maxStrain, b.maxStrain);
+	return s;
+}
+
+// the last window samples of a repeating interval, frame to frame times of the render loop or the
+// time a physics tick took, with what says how evenly they come: spread and the slow tail
+class IntervalStats {
+	public:
+		IntervalStats(size_t window = 600) : window(window) {}
+
+		void add(double seconds) {
+			if (sample.size() < window) {
+				sample.push_back(seconds);
+			} else {
+				sample[next] = seconds;
+			}
+			next = (next + 1) % window;
+		}
+
+		size_t size() const {
+			return sample.size();
+		}
+
+		void clear() {
+			sample.clear();
+			next = 0;
+		}
+
+		double mean() const {
+			double sum = 0.0;
+			for (double s : sample) {
+				sum += s;
+			}
+			return sample.empty() ? 0.0 : sum / sample.size();
+		}
+
+		double stddev() const {
+			double m = mean();
+			double sum = 0.0;
+			for (double s : sample) {
+				sum += (s - m) * (s - m);
+			}
+			return sample.empty() ? 0.0 : sqrt(sum / sample.size());
+		}
+
+		// the sample p of the way up the sorted window, 0.99 for the 99th percentile
+		double percentile(double p) const {
+			if (sample.empty()) {
+				return 0.0;
+			}
+			vector<double> sorted(sample);
+			size_t k = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+			nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+			return sorted[k];
+		}
+
+		double worst() const {
+			return sample.empty() ? 0.0 : *max_element(sample.begin(), sample.end());
+		}
+
+	private:
+		size_t window;
+		size_t next = 0;
+		vector<double> sample;
+};
+
+#endif
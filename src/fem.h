@@ -0,0 +1,306 @@
+#ifndef FEM_H
+#define FEM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "chebyshev.h"
+#include "rotation.h"
+
+// co-rotational linear elasticity over tetrahedra, in place of the springs. each cell of a lattice
+// cage is split into five tets, neighbouring cells mirrored so the faces between them match. a tet
+// keeps the inverse of its rest edge matrix Dm and its rest volume V. each step the deformation
+// gradient F = Ds Dm^-1 is split into its rotation R and what's left, the stress
+// P = 2 mu (F - R) + lambda tr(R^T F - I) R pushes on the corners with -V P Dm^-T, and a viscous
+// stress on the rotated strain rate damps deformation without damping spin. R is refined from the
+// tet's previous one by a couple of iterations of muller et al. 16, no svd, and it stays smooth
+// through a flat or inverted tet. tets work out their corner forces in parallel and every node
+// gathers its own, so no two threads write one node and the sum doesn't depend on the thread count
+class FemSolver {
+	public:
+		float youngsModulus = 1000.0f;
+		float poissonRatio = 0.3f;
+		// viscosity of the strain rate
+		float damping = 1.0f;
+		// rotation refinement iterations per tet per step
+		int rotationIterations = 2;
+
+		// fraction of the stability limit used, and the most substeps a tick is split into
+		float safety = 0.8f;
+		int maxSubsteps = 64;
+		// from the last build
+		float stableStep = 0.0f;
+
+		size_t numElements() const {
+			return element.size();
+		}
+
+		// rebuilds the tets when the topology changed, returns false when the cage isn't a lattice
+		bool update(const NodeStore& pts, const NodeGrid& grid, const CageTopology& topo) {
+			if (grid.empty() || grid.coord.size() != pts.size()) {
+				return false;
+			}
+			if (&topo != builtFor || topo.revision != builtRevision
+				|| !equal(pts.mass.begin(), pts.mass.end(), builtMass.begin(), builtMass.end())) {
+				build(pts, grid);
+				builtFor = &topo;
+				builtRevision = topo.revision;
+				builtMass.assign(pts.mass.begin(), pts.mass.end());
+			}
+			return true;
+		}
+
+		// substeps a tick of dt needs to stay under the stability limit
+		int substeps(float dt) const {
+			if (!(stableStep > 0.0f)) {
+				return 1;
+			}
+			return std::min(maxSubsteps, std::max(1, (int)ceil(dt / stableStep)));
+		}
+
+		// one explicit (verlet) step of h. pts.force must hold the external forces, the element forces
+		// are added here. floorY is in the cage's local coordinates
+		void step(NodeStore& pts, float h, float floorY) {
+			const size_t n = pts.size();
+			ThreadPool& pool = ThreadPool::shared();
+			elementForces(pts, h);
+
+			const float h2 = h * h;
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 f = pts.force[i];
+					for (unsigned int c = nodeOffsets[i]; c < nodeOffsets[i + 1]; ++c) {
+						f += cornerForce[nodeCorner[c]];
+					}
+
+					vec3 p = pts.position[i];
+					vec3 next = p + (p - pts.previous[i]) + f * pts.invMass[i] * h2;
+					if (next.y < floorY) {
+						next.y = floorY;
+						f = vec3(0, -9.8f, 0.0);
+					}
+					pts.force[i] = f;
+					pts.previous[i] = p;
+					pts.position[i] = next;
+				}
+			});
+		}
+
+		// elastic energy of the current shape, rotations as of the last step
+		double potential(const NodeStore& pts) const {
+			const float mu = lameMu();
+			const float lambda = lameLambda();
+			return ThreadPool::shared().parallelReduce(0, element.size(), SOLVER_GRAIN, 0.0, [&](size_t begin, size_t end) {
+				double sum = 0.0;
+				for (size_t e = begin; e < end; ++e) {
+					const Element& t = element[e];
+					mat3 F = edges(pts.position.data(), t) * t.invRest;
+					mat3 R = mat3_cast(t.rotation);
+					mat3 S = F - R;
+					float trace = dot(R[0], F[0]) + dot(R[1], F[1]) + dot(R[2], F[2]) - 3.0f;
+					float frobenius = dot(S[0], S[0]) + dot(S[1], S[1]) + dot(S[2], S[2]);
+					sum += t.volume * (mu * frobenius + 0.5f * lambda * trace * trace);
+				}
+				return sum;
+			}, [](double a, double b) { return a + b; });
+		}
+
+	private:
+		struct Element {
+			uvec4 node;
+			mat3 invRest;
+			float volume;
+			quat rotation;
+		};
+
+		vector<Element> element;
+		// corners of the tets each node is in, cornerForce[4 * e + c] is corner c of tet e
+		aligned_vector<unsigned int> nodeOffsets;
+		aligned_vector<unsigned int> nodeCorner;
+		aligned_vector<vec3> cornerForce;
+
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+		vector<float> builtMass;
+
+		float lameMu() const {
+			return youngsModulus / (2.0f * (1.0f + poissonRatio));
+		}
+
+		float lameLambda() const {
+			return youngsModulus * poissonRatio / ((1.0f + poissonRatio) * (1.0f - 2.0f * poissonRatio));
+		}
+
+		// columns are corners 1, 2 and 3 less corner 0
+		static mat3 edges(const vec3* x, const Element& t) {
+			vec3 x0 = x[t.node[0]];
+			return mat3(x[t.node[1]] - x0, x[t.node[2]] - x0, x[t.node[3]] - x0);
+		}
+
+		void build(const NodeStore& pts, const NodeGrid& grid) {
+			const ivec3 dims = grid.dims;
+			// lattice coordinate to node, the cage may have been reordered since it was built
+			vector<unsigned int> nodeAt((size_t)dims.x * dims.y * dims.z, 0);
+			for (size_t i = 0; i < grid.coord.size(); ++i) {
+				const ivec3& c = grid.coord[i];
+				nodeAt[(c.x * dims.y + c.y) * dims.z + c.z] = (unsigned int)i;
+			}
+			auto at = [&](ivec3 c) {
+				return nodeAt[(c.x * dims.y + c.y) * dims.z + c.z];
+			};
+
+			// a corner tet on each of four corners that don't share an edge, and the tet of the
+			// other four in the middle. odd cells use the other four corners
+			static const ivec3 evenCorner[4] = { ivec3(0, 0, 0), ivec3(1, 1, 0), ivec3(1, 0, 1), ivec3(0, 1, 1) };
+			static const ivec3 oddCorner[4] = { ivec3(1, 0, 0), ivec3(0, 1, 0), ivec3(0, 0, 1), ivec3(1, 1, 1) };
+
+			element.clear();
+			for (int x = 0; x + 1 < dims.x; ++x) {
+				for (int y = 0; y + 1 < dims.y; ++y) {
+					for (int z = 0; z + 1 < dims.z; ++z) {
+						const ivec3 cell(x, y, z);
+						const bool odd = (x + y + z) % 2 != 0;
+						const ivec3* corner = odd ? oddCorner : evenCorner;
+						const ivec3* other = odd ? evenCorner : oddCorner;
+						for (int t = 0; t < 4; ++t) {
+							// the corner and its three neighbours along the axes
+							ivec3 c = corner[t];
+							addElement(grid, at(cell + c),
+								at(cell + ivec3(1 - c.x, c.y, c.z)),
+								at(cell + ivec3(c.x, 1 - c.y, c.z)),
+								at(cell + ivec3(c.x, c.y, 1 - c.z)));
+						}
+						addElement(grid, at(cell + other[0]), at(cell + other[1]), at(cell + other[2]), at(cell + other[3]));
+					}
+				}
+			}
+
+			const size_t n = pts.size();
+			nodeOffsets.assign(n + 1, 0);
+			for (const Element& t : element) {
+				for (int c = 0; c < 4; ++c) {
+					++nodeOffsets[t.node[c] + 1];
+				}
+			}
+			for (size_t i = 1; i <= n; ++i) {
+				nodeOffsets[i] += nodeOffsets[i - 1];
+			}
+			nodeCorner.resize(4 * element.size());
+			vector<unsigned int> cursor(nodeOffsets.begin(), nodeOffsets.end() - 1);
+			for (size_t e = 0; e < element.size(); ++e) {
+				for (int c = 0; c < 4; ++c) {
+					nodeCorner[cursor[element[e].node[c]]++] = (unsigned int)(4 * e + c);
+				}
+			}
+			cornerForce.assign(4 * element.size(), vec3(0.0f));
+
+			analyze(pts);
+		}
+
+		// rest shape from the lattice, corners swapped if needed so every tet has positive volume
+		void addElement(const NodeGrid& grid, unsigned int a, unsigned int b, unsigned int c, unsigned int d) {
+			Element t;
+			t.node = uvec4(a, b, c, d);
+			vec3 x0 = vec3(grid.coord[a]) * grid.spacing;
+			mat3 Dm(vec3(grid.coord[b]) * grid.spacing - x0,
+				vec3(grid.coord[c]) * grid.spacing - x0,
+				vec3(grid.coord[d]) * grid.spacing - x0);
+			float det = determinant(Dm);
+			if (det < 0.0f) {
+				swap(t.node[2], t.node[3]);
+				swap(Dm[1], Dm[2]);
+				det = -det;
+			}
+			t.invRest = inverse(Dm);
+			t.volume = det / 6.0f;
+			t.rotation = quat(1.0f, 0.0f, 0.0f, 0.0f);
+			element.push_back(t);
+		}
+
+		// stability limit 2 / (omega + c) with omega^2 the largest eigenvalue of M^-1 K and c that of
+		// M^-1 D, both linearized at rest and estimated by power iteration like the springs' are
+		void analyze(const NodeStore& pts) {
+			const size_t n = pts.size();
+
+			// v <- M^-1 K v for the stress a (G + G^T) + b tr(G) I of the displacement gradient G
+			auto linearized = [&](float a, float b) {
+				return [this, &pts, a, b, n](const vector<float>& in, vector<float>& out) {
+					fill(out.begin(), out.end(), 0.0f);
+					auto node = [&](unsigned int i) {
+						return vec3(in[3 * i], in[3 * i + 1], in[3 * i + 2]);
+					};
+					for (const Element& t : element) {
+						vec3 u0 = node(t.node[0]);
+						mat3 G = mat3(node(t.node[1]) - u0, node(t.node[2]) - u0, node(t.node[3]) - u0) * t.invRest;
+						mat3 P = a * (G + transpose(G)) + b * (G[0][0] + G[1][1] + G[2][2]) * mat3(1.0f);
+						mat3 H = t.volume * P * transpose(t.invRest);
+						vec3 corner[4] = { -(H[0] + H[1] + H[2]), H[0], H[1], H[2] };
+						for (int c = 0; c < 4; ++c) {
+							unsigned int i = t.node[c];
+							out[3 * i] += corner[c].x;
+							out[3 * i + 1] += corner[c].y;
+							out[3 * i + 2] += corner[c].z;
+						}
+					}
+					for (size_t i = 0; i < n; ++i) {
+						out[3 * i] *= pts.invMass[i];
+						out[3 * i + 1] *= pts.invMass[i];
+						out[3 * i + 2] *= pts.invMass[i];
+					}
+				};
+			};
+			float stiffness = estimateSpectralRadius(3 * n, linearized(lameMu(), lameLambda()));
+			float viscosity = estimateSpectralRadius(3 * n, linearized(damping, 0.0f));
+
+			float limit = sqrt(stiffness) + viscosity;
+			stableStep = limit > 0.0f ? safety * 2.0f / limit : 0.0f;
+		}
+
+		// every tet's four corner forces into cornerForce, velocities from position - previous over h
+		void elementForces(const NodeStore& pts, float h) {
+			const float mu = lameMu();
+			const float lambda = lameLambda();
+			const float invH = 1.0f / h;
+			const vec3* position = pts.position.data();
+			const vec3* previous = pts.previous.data();
+
+			ThreadPool::shared().parallelFor(0, element.size(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t e = begin; e < end; ++e) {
+					Element& t = element[e];
+					mat3 F = edges(position, t) * t.invRest;
+					t.rotation = extractRotation(F, t.rotation, rotationIterations);
+					mat3 R = mat3_cast(t.rotation);
+
+					float trace = dot(R[0], F[0]) + dot(R[1], F[1]) + dot(R[2], F[2]) - 3.0f;
+					mat3 P = 2.0f * mu * (F - R) + lambda * trace * R;
+
+					if (damping > 0.0f) {
+						vec3 v0 = position[t.node[0]] - previous[t.node[0]];
+						mat3 Vs(position[t.node[1]] - previous[t.node[1]] - v0,
+							position[t.node[2]] - previous[t.node[2]] - v0,
+							position[t.node[3]] - previous[t.node[3]] - v0);
+						mat3 rate = transpose(R) * (Vs * t.invRest) * invH;
+						P += R * (damping * (rate + transpose(rate)));
+					}
+
+					mat3 H = -t.volume * P * transpose(t.invRest);
+					cornerForce[4 * e + 1] = H[0];
+					cornerForce[4 * e + 2] = H[1];
+					cornerForce[4 * e + 3] = H[2];
+					cornerForce[4 * e] = -(H[0] + H[1] + H[2]);
+				}
+			});
+		}
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+
+using namespace std;
+
+// stand-ins for the gl and glfw calls cages make, so the tests and benchmarks can build and step
+// cages without a window or a gl context. include it in exactly one translation unit and call
+// initHeadless() before the first cage is built. every buffer is named 1 and uploads go nowhere,
+// no key is ever down, there's never a current context and glfwGetTime counts from the first call
+
+extern "C" {
+int glfwGetKey(GLFWwindow*, int) {
+	return GLFW_RELEASE;
+}
+
+GLFWwindow* glfwGetCurrentContext() {
+	return nullptr;
+}
+
+double glfwGetTime() {
+	static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+}
+
+namespace headless {
+	void APIENTRY genNames(GLsizei n, GLuint* names) {
+		for (GLsizei i = 0; i < n; ++i) {
+			names[i] = 1;
+		}
+	}
+
+	void APIENTRY bindVertexArray(GLuint) {}
+	void APIENTRY bindBuffer(GLenum, GLuint) {}
+	void APIENTRY bufferData(GLenum, GLsizeiptr, const void*, GLenum) {}
+	void APIENTRY vertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) {}
+	void APIENTRY enableVertexAttribArray(GLuint) {}
+}
+
+void initHeadless() {
+	glad_glGenVertexArrays = headless::genNames;
+	glad_glGenBuffers = headless::genNames;
+	glad_glBindVertexArray = headless::bindVertexArray;
+	glad_glBindBuffer = headless::bindBuffer;
+	glad_glBufferData = headless::bufferData;
+	glad_glVertexAttribPointer = headless::vertexAttribPointer;
+	glad_glEnableVertexAttribArray = headless::enableVertexAttribArray;
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef IMPLICIT_H
+#define IMPLICIT_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "springkernel.h"
+#include "bsr.h"
+#include "multigrid.h"
+
+// linearized backward euler (baraff & witkin 98) for a cage's springs:
+//     (M - h dF/dv - h^2 dF/dx) dv = h (f0 + h dF/dx v0)
+// solved matrix-free with block-jacobi preconditioned conjugate gradient. each spring contributes one
+// symmetric 3x3 block B = h^2 Ks + h Ds to its two diagonal entries and -B to the off-diagonal pair.
+// nodes that would end the step below the floor get their vertical dv prescribed so they land on it,
+// and the solve runs on the remaining degrees of freedom (the filtered pcg from the same paper).
+// with assembled set the blocks go into a BlockSparseMatrix and the products run row by row instead,
+// which streams twice the matrix data but splits across threads without the per-color barriers.
+// with multigrid set and a lattice to coarsen, a multigrid v-cycle replaces block jacobi as the
+// preconditioner, which keeps the iteration count roughly flat as the lattice is refined
+class ImplicitSolver {
+	public:
+		int maxIterations = 64;
+		// stop once |r| <= tolerance * |b|
+		float tolerance = 1e-4f;
+		bool assembled = false;
+		bool multigrid = false;
+		MultigridPreconditioner preconditioner;
+
+		// stats of the last solve
+		int lastIterations = 0;
+		float lastResidual = 0.0f;
+
+		// advances pts by h. pts.force must hold the external forces, spring forces are added here.
+		// floorY is in the cage's local coordinates, grid is the cage's lattice if it has one
+		void step(NodeStore& pts, const CageTopology& topo, float h, float floorY, const NodeGrid* grid = nullptr) {
+			const size_t n = pts.size();
+			resize(n, topo.numSprings());
+			useMatrix = assembled || (multigrid && grid && !grid->empty());
+			if (useMatrix) {
+				A.build(topo, n);
+				A.setZero();
+			}
+
+			const float invH = 1.0f / h;
+			const vec3* position = pts.position.data();
+			const vec3* previous = pts.previous.data();
+
+			ThreadPool& pool = ThreadPool::shared();
+
+			// current velocities, floor contacts, and the mass part of the diagonal
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					velocity[i] = (position[i] - previous[i]) * invH;
+					rhs[i] = h * pts.force[i];
+					diag[i] = mat3(pts.mass[i]);
+					if (useMatrix) {
+						A.values[A.diagonalSlot[i]] = diag[i];
+					}
+
+					float landing = (floorY - position[i].y) * invH;
+					contact[i] = position[i].y + h * velocity[i].y < floorY;
+					prescribed[i] = contact[i] ? landing - velocity[i].y : 0.0f;
+				}
+			});
+
+			// spring forces, jacobian blocks, and their share of rhs and the diagonal
+			forEachSpringBatch(topo, [&](size_t begin, size_t end) {
+				for (size_t s = begin; s < end; ++s) {
+					const unsigned int a = topo.v0[s];
+					const unsigned int b = topo.v1[s];
+
+					vec3 x = position[a] - position[b];
+					float len = length(x);
+					if (len * len <= SPRING_MIN_LENGTH2) {
+						blocks[s] = mat3(0.0f);
+						continue;
+					}
+					vec3 d = x / len;
+					mat3 ddT = outerProduct(d, d);
+
+					// -dF/dx, with the transverse term clamped so the block stays positive semi-definite
+					float transverse = std::max(0.0f, 1.0f - topo.restLength[s] / len);
+					mat3 stiffness = topo.k[s] * (ddT + transverse * (mat3(1.0f) - ddT));
+					mat3 B = (h * h) * stiffness + (h * topo.kd[s]) * ddT;
+					blocks[s] = B;
+					if (useMatrix) {
+						A.addSpring(s, a, b, B);
+					}
+
+					vec3 vRel = velocity[a] - velocity[b];
+					vec3 f = -(topo.k[s] * (len - topo.restLength[s]) + topo.kd[s] * dot(vRel, d)) * d;
+					vec3 r = h * f - (h * h) * (stiffness * vRel);
+
+					rhs[a] += r;
+					rhs[b] -= r;
+					diag[a] += B;
+					diag[b] += B;
+				}
+			});
+
+			useMultigrid = useMatrix && multigrid && grid && preconditioner.update(*grid, topo, A);
+			if (useMatrix) {
+				A.blockJacobi(invDiag);
+			} else {
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						invDiag[i] = inverse(diag[i]);
+					}
+				});
+			}
+
+			solve(pts, topo);
+
+			// dv -> new velocity -> positions, keeping verlet's position/previous form
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 v = velocity[i] + dv[i];
+					pts.previous[i] = pts.position[i];
+					pts.position[i] += h * v;
+				}
+			});
+		}
+
+	private:
+		BlockSparseMatrix A;
+		// what this step runs on, see assembled and multigrid
+		bool useMatrix = false;
+		bool useMultigrid = false;
+		aligned_vector<vec3> velocity;
+		aligned_vector<vec3> rhs;
+		aligned_vector<vec3> dv;
+		aligned_vector<vec3> r;
+		aligned_vector<vec3> z;
+		aligned_vector<vec3> p;
+		aligned_vector<vec3> Ap;
+		aligned_vector<mat3> diag;
+		aligned_vector<mat3> invDiag;
+		aligned_vector<mat3> blocks;
+		// floor contacts, and the vertical dv they are held to
+		vector<unsigned char> contact;
+		aligned_vector<float> prescribed;
+
+		void resize(size_t n, size_t numSprings) {
+			contact.resize(n);
+			prescribed.resize(n);
+			velocity.resize(n);
+			rhs.resize(n);
+			dv.resize(n);
+			r.resize(n);
+			z.resize(n);
+			p.resize(n);
+			Ap.resize(n);
+			diag.resize(n);
+			invDiag.resize(n);
+			blocks.resize(numSprings);
+		}
+
+		// y = A x
+		void multiply(const NodeStore& pts, const CageTopology& topo, const aligned_vector<vec3>& x, aligned_vector<vec3>& y) {
+			if (useMatrix) {
+				A.multiply(x, y);
+				return;
+			}
+			ThreadPool::shared().parallelFor(0, x.size(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					y[i] = pts.mass[i] * x[i];
+				}
+			});
+			forEachSpringBatch(topo, [&](size_t begin, size_t end) {
+				for (size_t s = begin; s < end; ++s) {
+					vec3 t = blocks[s] * (x[topo.v0[s]] - x[topo.v1[s]]);
+					y[topo.v0[s]] += t;
+					y[topo.v1[s]] -= t;
+				}
+			});
+		}
+
+		float dotProduct(const aligned_vector<vec3>& a, const aligned_vector<vec3>& b) {
+			return (float)ThreadPool::shared().parallelReduce(0, a.size(), SOLVER_GRAIN, 0.0, [&](size_t begin, size_t end) {
+				double sum = 0.0;
+				for (size_t i = begin; i < end; ++i) {
+					sum += dot(a[i], b[i]);
+				}
+				return sum;
+			});
+		}
+
+		// z = S M^-1 r with a v-cycle standing in for M^-1
+		void applyMultigrid(size_t n) {
+			preconditioner.apply(r, z);
+			ThreadPool::shared().parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					z[i] = filter(i, z[i]);
+				}
+			});
+		}
+
+		// drops the constrained (vertical, in contact) component
+		vec3 filter(size_t i, vec3 v) const {
+			if (contact[i]) {
+				v.y = 0.0f;
+			}
+			return v;
+		}
+
+		void solve(const NodeStore& pts, const CageTopology& topo) {
+			const size_t n = pts.size();
+			ThreadPool& pool = ThreadPool::shared();
+
+			// dv starts at the prescribed values, r = S (b - A dv), z = S P^-1 r, p = z
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					dv[i] = vec3(0.0f, prescribed[i], 0.0f);
+				}
+			});
+			multiply(pts, topo, dv, Ap);
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					r[i] = filter(i, rhs[i] - Ap[i]);
+					z[i] = filter(i, invDiag[i] * r[i]);
+				}
+			});
+			if (useMultigrid) {
+				applyMultigrid(n);
+			}
+			p.assign(z.begin(), z.end());
+
+			float bNorm = sqrt(dotProduct(r, r));
+			float rz = dotProduct(r, z);
+			lastIterations = 0;
+			lastResidual = bNorm;
+			if (bNorm == 0.0f) {
+				return;
+			}
+
+			for (int it = 0; it < maxIterations; ++it) {
+				multiply(pts, topo, p, Ap);
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						Ap[i] = filter(i, Ap[i]);
+					}
+				});
+				float pAp = dotProduct(p, Ap);
+				if (pAp <= 0.0f) {
+					break;
+				}
+				float alpha = rz / pAp;
+
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						dv[i] += alpha * p[i];
+						r[i] -= alpha * Ap[i];
+						if (!useMultigrid) {
+							z[i] = filter(i, invDiag[i] * r[i]);
+						}
+					}
+				});
+				if (useMultigrid) {
+					applyMultigrid(n);
+				}
+
+				lastIterations = it + 1;
+				lastResidual = sqrt(dotProduct(r, r));
+				if (lastResidual <= tolerance * bNorm) {
+					break;
+				}
+
+				float rzNext = dotProduct(r, z);
+				float beta = rzNext / rz;
+				rz = rzNext;
+
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						p[i] = z[i] + beta * p[i];
+					}
+				});
+			}
+		}
+};
+
+#endif
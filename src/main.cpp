@@ -14,6 +14,11 @@
 #include "camera.h"
 #include "model.h"
 #include "cage.h"
+#include "timestep.h"
+#include "taskgraph.h"
+#include "physicsthread.h"
+#include "contact.h"
+#include "diagnostics.h"
 
 using namespace std;
 using namespace glm;
@@ -49,7 +54,16 @@ const float nclip = 1.0f;
 
 // physics
 const float dt = 1.0f / 60;
-float tAccum = 0.0f;
+const int PHYSICS_SUBSTEPS = 1;
+const int MAX_TICKS_PER_FRAME = 5;
+FixedStepper stepper(dt, PHYSICS_SUBSTEPS, MAX_TICKS_PER_FRAME);
+// physics on a thread of its own, false steps it on this one between frames
+const bool PHYSICS_THREAD = true;
+// the physics tick's task graph when it runs here. T prints where the last tick spent the time
+// and how evenly the frames came
+TaskGraph physics;
+bool dumpPhysicsTimings = false;
+IntervalStats frameTimes;
 
 // render settings
 DrawMode mode = OBJECT;
@@ -297,6 +311,19 @@ int main() {
 
 	Cage c(pts, springs, pos);*/
 
+	// every cage gets its own chain of tasks in the physics graph, contacts run once they're done
+	vector<Cage*> cages = { &c };
+	CageContacts contacts;
+	contacts.distance = c.shape->grid.spacing;
+	PhysicsThread physicsThread(cages, stepper);
+	physicsThread.contacts = &contacts;
+	vector<vec3> snapshotVertices;
+	// per cage, whether its rest pose has gone to the gpu since the snapshots started saying it sleeps
+	vector<unsigned char> restUploaded(cages.size(), 0);
+	if (PHYSICS_THREAD) {
+		physicsThread.start();
+	}
+
 	// render loop
 	lastFrame = glfwGetTime();
 	while (!glfwWindowShouldClose(window)) {
@@ -304,6 +331,7 @@ int main() {
 		float currentFrame = glfwGetTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
+		frameTimes.add(deltaTime);
 		
 		processInput(window); // handle inputs
 
@@ -318,22 +346,62 @@ int main() {
 		// forces should be mutated because of that
 
 		// physics
-		tAccum += deltaTime;
-		//cout << "dt: " << deltaTime << " | accum: " << tAccum << endl;
-		if (tAccum >= dt) {
-			// Verlet
-			// c.applyForces(vec3(0.0f, -9.81f, 0.0f));//(window);
-			// c.applyForces(vec3(0.0f, -9.81f, 0.0f));
-			c.updatePhysics(window, dt);
-			// c.applyWorldAndUserForces(window, deltaTime);
-			// c.springCorrectionForces(dt);
-			// c.friction(dt, 0.9f);
-			c.verletStep(dt, 0.7f);
-
-			c.satisfyConstraints(0.0f);
-			c.springConstrain();
-			c.refreshMesh();
-			tAccum = 0;
+		vec3 input = c.readInputForce(window);
+		if (PHYSICS_THREAD) {
+			// whatever the physics thread last published, played back at the time of this frame
+			physicsThread.setInput(input);
+			const PhysicsSnapshot& snapshot = physicsThread.latest();
+			if (snapshot.tick > 0) {
+				double t = physicsThread.now();
+				for (size_t k = 0; k < cages.size(); ++k) {
+					if (snapshot.asleep[k]) {
+						// the pose doesn't change while asleep, upload it once
+						if (restUploaded[k]) {
+							continue;
+						}
+						restUploaded[k] = 1;
+					} else {
+						restUploaded[k] = 0;
+					}
+					snapshot.interpolate(k, t, snapshotVertices);
+					cages[k]->uploadMesh(snapshotVertices.data());
+				}
+			}
+		} else {
+			int ticks = stepper.advance(deltaTime);
+			//cout << "dt: " << deltaTime << " | ticks: " << ticks << endl;
+			// a graph per tick, the cages side by side. the last one stages the vertices too, the
+			// upload itself has to stay on this thread
+			for (int i = 0; i < std::max(ticks, 1); ++i) {
+				physics.clear();
+				vector<TaskGraph::TaskId> ticked;
+				if (i < ticks) {
+					ticked = addTickTasks(physics, cages, input, stepper, 0.0f, &contacts);
+				}
+				if (i + 1 >= ticks) {
+					for (size_t k = 0; k < cages.size(); ++k) {
+						vector<TaskGraph::TaskId> after;
+						if (!ticked.empty()) {
+							after.push_back(ticked[k]);
+						}
+						cages[k]->addStagingTask(physics, "cage " + to_string(k), stepper.alpha(), after);
+					}
+				}
+				physics.run();
+			}
+			for (Cage* cage : cages) {
+				cage->uploadMesh();
+			}
+		}
+		if (dumpPhysicsTimings) {
+			cout << "frames: " << frameTimes.mean() * 1e3 << " ms mean, " << frameTimes.stddev() * 1e3 << " ms deviation, "
+				<< frameTimes.percentile(0.99) * 1e3 << " ms 99th percentile, " << frameTimes.worst() * 1e3 << " ms worst" << endl;
+			if (PHYSICS_THREAD) {
+				physicsThread.dumpTimings();
+			} else {
+				physics.dumpTimings(cout);
+			}
+			dumpPhysicsTimings = false;
 		}
 
 		// camera
@@ -421,6 +489,7 @@ int main() {
 	}
 
 	// clean glfw resources
+	physicsThread.stop();
 	glfwTerminate();
 	return 0;
 }
@@ -458,6 +527,14 @@ void processInput(GLFWwindow* window) {
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) {
 		mode = PHYSICS;
 	}
+
+	// once per press
+	static bool timingKeyDown = false;
+	bool timingKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+	if (timingKey && !timingKeyDown) {
+		dumpPhysicsTimings = true;
+	}
+	timingKeyDown = timingKey;
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
@@ -0,0 +1,317 @@
+#ifndef MULTIGRID_H
+#define MULTIGRID_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "bsr.h"
+
+// geometric multigrid v-cycle over a lattice cage, used as a preconditioner. every level halves the
+// lattice, a node of the finer level sits on a coarse node or between two, four or eight of them and
+// takes their values with trilinear weights (prolongation), its residual goes back to them with the
+// same weights (restriction). coarse operators are the galerkin products P^T A P, refreshed from the
+// fine matrix every update. damped block jacobi smooths, the same number of sweeps before and after
+// the coarse correction so the cycle stays symmetric and can precondition conjugate gradient
+class MultigridPreconditioner {
+	public:
+		int smoothingSteps = 2;
+		float omega = 0.6f;
+		// jacobi sweeps that stand in for a solve on the coarsest level
+		int coarseSweeps = 20;
+
+		size_t levels() const {
+			return level.size();
+		}
+
+		// rebuilds the hierarchy when the topology changed, then refreshes the coarse operators from A.
+		// returns false when the grid doesn't match A or can't be halved even once
+		bool update(const NodeGrid& grid, const CageTopology& topo, const BlockSparseMatrix& A) {
+			if (&topo != builtFor || topo.revision != builtRevision || level.empty() || level[0].size != A.rows()) {
+				build(grid, A);
+				builtFor = &topo;
+				builtRevision = topo.revision;
+			}
+			if (level.size() < 2) {
+				return false;
+			}
+
+			level[0].A = &A;
+			A.blockJacobi(level[0].invDiag);
+			for (size_t l = 1; l < level.size(); ++l) {
+				galerkin(level[l - 1], level[l]);
+				level[l].A->blockJacobi(level[l].invDiag);
+			}
+			return true;
+		}
+
+		// z = one v-cycle applied to r
+		void apply(const aligned_vector<vec3>& r, aligned_vector<vec3>& z) {
+			level[0].b.assign(r.begin(), r.end());
+			cycle(0);
+			z.assign(level[0].x.begin(), level[0].x.end());
+		}
+
+	private:
+		struct Level {
+			size_t size = 0;
+			ivec3 dims = ivec3(0);
+			// the fine level borrows the solver's matrix, coarse levels own theirs
+			const BlockSparseMatrix* A = nullptr;
+			BlockSparseMatrix own;
+			aligned_vector<mat3> invDiag;
+
+			// transfer to the next coarser level: the coarse nodes each node of this level takes its
+			// value from and their weights, and the nodes of this level each coarse node gathers from
+			aligned_vector<unsigned int> parentOffsets;
+			aligned_vector<unsigned int> parent;
+			aligned_vector<float> parentWeight;
+			aligned_vector<unsigned int> childOffsets;
+			aligned_vector<unsigned int> child;
+			aligned_vector<float> childWeight;
+
+			aligned_vector<vec3> b;
+			aligned_vector<vec3> x;
+			aligned_vector<vec3> r;
+		};
+
+		vector<Level> level;
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+
+		static bool halves(ivec3 dims) {
+			ivec3 cells = dims - 1;
+			return cells.x >= 2 && cells.y >= 2 && cells.z >= 2
+				&& cells.x % 2 == 0 && cells.y % 2 == 0 && cells.z % 2 == 0;
+		}
+
+		static unsigned int index(ivec3 c, ivec3 dims) {
+			return (unsigned int)((c.x * dims.y + c.y) * dims.z + c.z);
+		}
+
+		void build(const NodeGrid& grid, const BlockSparseMatrix& A) {
+			level.clear();
+			if (grid.coord.size() != A.rows() || !halves(grid.dims)) {
+				level.resize(1);
+				level[0].size = A.rows();
+				return;
+			}
+
+			// coarse levels number their nodes x-major, the fine level goes through grid.coord
+			vector<ivec3> coord = grid.coord;
+			ivec3 dims = grid.dims;
+			level.emplace_back();
+			level[0].size = coord.size();
+			level[0].dims = dims;
+
+			while (halves(dims)) {
+				ivec3 coarseDims = (dims - 1) / 2 + 1;
+				Level& fine = level.back();
+				linkParents(fine, coord, coarseDims);
+
+				Level coarse;
+				coarse.size = (size_t)coarseDims.x * coarseDims.y * coarseDims.z;
+				coarse.dims = coarseDims;
+				linkChildren(fine, coarse);
+				level.push_back(move(coarse));
+
+				coord.resize(level.back().size);
+				for (int x = 0; x < coarseDims.x; ++x) {
+					for (int y = 0; y < coarseDims.y; ++y) {
+						for (int z = 0; z < coarseDims.z; ++z) {
+							coord[index(ivec3(x, y, z), coarseDims)] = ivec3(x, y, z);
+						}
+					}
+				}
+				dims = coarseDims;
+			}
+
+			// coarse patterns: I and J are coupled when a child of I is coupled to a child of J
+			const BlockSparseMatrix* fineA = &A;
+			for (size_t l = 1; l < level.size(); ++l) {
+				Level& fine = level[l - 1];
+				Level& coarse = level[l];
+				vector<vector<unsigned int>> pattern(coarse.size);
+				for (size_t I = 0; I < coarse.size; ++I) {
+					pattern[I].push_back((unsigned int)I);
+					for (unsigned int c = coarse.childOffsets[I]; c < coarse.childOffsets[I + 1]; ++c) {
+						unsigned int i = coarse.child[c];
+						for (unsigned int k = fineA->rowOffsets[i]; k < fineA->rowOffsets[i + 1]; ++k) {
+							unsigned int j = fineA->columns[k];
+							for (unsigned int p = fine.parentOffsets[j]; p < fine.parentOffsets[j + 1]; ++p) {
+								pattern[I].push_back(fine.parent[p]);
+							}
+						}
+					}
+				}
+				coarse.own.setPattern(pattern);
+				coarse.A = &coarse.own;
+				fineA = coarse.A;
+			}
+
+			for (auto& L : level) {
+				L.b.resize(L.size);
+				L.x.resize(L.size);
+				L.r.resize(L.size);
+			}
+		}
+
+		// trilinear parents: along each axis an even coordinate sits on coarse node c / 2, an odd one
+		// halfway between c / 2 and c / 2 + 1
+		static void linkParents(Level& fine, const vector<ivec3>& coord, ivec3 coarseDims) {
+			fine.parentOffsets.assign(1, 0);
+			fine.parent.clear();
+			fine.parentWeight.clear();
+			for (const ivec3& c : coord) {
+				int count[3];
+				for (int a = 0; a < 3; ++a) {
+					count[a] = c[a] % 2 == 0 ? 1 : 2;
+				}
+				float w = 1.0f / (count[0] * count[1] * count[2]);
+				for (int dx = 0; dx < count[0]; ++dx) {
+					for (int dy = 0; dy < count[1]; ++dy) {
+						for (int dz = 0; dz < count[2]; ++dz) {
+							fine.parent.push_back(index(c / 2 + ivec3(dx, dy, dz), coarseDims));
+							fine.parentWeight.push_back(w);
+						}
+					}
+				}
+				fine.parentOffsets.push_back((unsigned int)fine.parent.size());
+			}
+		}
+
+		// the same links turned around, grouped by coarse node
+		static void linkChildren(const Level& fine, Level& coarse) {
+			coarse.childOffsets.assign(coarse.size + 1, 0);
+			for (unsigned int J : fine.parent) {
+				++coarse.childOffsets[J + 1];
+			}
+			for (size_t I = 1; I <= coarse.size; ++I) {
+				coarse.childOffsets[I] += coarse.childOffsets[I - 1];
+			}
+
+			coarse.child.resize(fine.parent.size());
+			coarse.childWeight.resize(fine.parent.size());
+			vector<unsigned int> cursor(coarse.childOffsets.begin(), coarse.childOffsets.end() - 1);
+			for (size_t i = 0; i < fine.size; ++i) {
+				for (unsigned int p = fine.parentOffsets[i]; p < fine.parentOffsets[i + 1]; ++p) {
+					unsigned int slot = cursor[fine.parent[p]]++;
+					coarse.child[slot] = (unsigned int)i;
+					coarse.childWeight[slot] = fine.parentWeight[p];
+				}
+			}
+		}
+
+		// fills coarse.A with P^T fine.A P, each coarse row gathered on its own. row I of P^T A is summed
+		// into a dense fine-sized scratch row first, so every fine column is spread to its parents once,
+		// and a dense map from coarse column to slot saves searching the coarse row
+		void galerkin(const Level& fine, Level& coarse) {
+			const BlockSparseMatrix& A = *fine.A;
+			BlockSparseMatrix& Ac = coarse.own;
+			ThreadPool::shared().parallelFor(0, coarse.size, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				vector<mat3> row(fine.size, mat3(0.0f));
+				vector<unsigned char> touched(fine.size, 0);
+				vector<unsigned int> used;
+				vector<unsigned int> slotOf(coarse.size);
+
+				for (size_t I = begin; I < end; ++I) {
+					for (unsigned int q = Ac.rowOffsets[I]; q < Ac.rowOffsets[I + 1]; ++q) {
+						slotOf[Ac.columns[q]] = q;
+						Ac.values[q] = mat3(0.0f);
+					}
+
+					used.clear();
+					for (unsigned int c = coarse.childOffsets[I]; c < coarse.childOffsets[I + 1]; ++c) {
+						const unsigned int i = coarse.child[c];
+						const float wi = coarse.childWeight[c];
+						for (unsigned int k = A.rowOffsets[i]; k < A.rowOffsets[i + 1]; ++k) {
+							const unsigned int j = A.columns[k];
+							if (!touched[j]) {
+								touched[j] = 1;
+								used.push_back(j);
+							}
+							row[j] += wi * A.values[k];
+						}
+					}
+
+					for (unsigned int j : used) {
+						for (unsigned int p = fine.parentOffsets[j]; p < fine.parentOffsets[j + 1]; ++p) {
+							Ac.values[slotOf[fine.parent[p]]] += fine.parentWeight[p] * row[j];
+						}
+						row[j] = mat3(0.0f);
+						touched[j] = 0;
+					}
+				}
+			});
+		}
+
+		// x <- x + omega D^-1 (b - A x), sweeps times. a zero x skips the first product
+		void smooth(Level& L, int sweeps, bool fromZero) {
+			ThreadPool& pool = ThreadPool::shared();
+			for (int s = 0; s < sweeps; ++s) {
+				if (fromZero && s == 0) {
+					pool.parallelFor(0, L.size, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+						for (size_t i = begin; i < end; ++i) {
+							L.x[i] = omega * (L.invDiag[i] * L.b[i]);
+						}
+					});
+					continue;
+				}
+				L.A->multiply(L.x, L.r);
+				pool.parallelFor(0, L.size, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						L.x[i] += omega * (L.invDiag[i] * (L.b[i] - L.r[i]));
+					}
+				});
+			}
+		}
+
+		void cycle(size_t l) {
+			Level& L = level[l];
+			if (l + 1 == level.size()) {
+				smooth(L, coarseSweeps, true);
+				return;
+			}
+
+			ThreadPool& pool = ThreadPool::shared();
+			Level& C = level[l + 1];
+
+			smooth(L, smoothingSteps, true);
+
+			// restrict the residual
+			L.A->multiply(L.x, L.r);
+			pool.parallelFor(0, C.size, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t I = begin; I < end; ++I) {
+					vec3 sum(0.0f);
+					for (unsigned int c = C.childOffsets[I]; c < C.childOffsets[I + 1]; ++c) {
+						unsigned int i = C.child[c];
+						sum += C.childWeight[c] * (L.b[i] - L.r[i]);
+					}
+					C.b[I] = sum;
+				}
+			});
+
+			cycle(l + 1);
+
+			// prolong the correction
+			pool.parallelFor(0, L.size, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 sum(0.0f);
+					for (unsigned int p = L.parentOffsets[i]; p < L.parentOffsets[i + 1]; ++p) {
+						sum += L.parentWeight[p] * C.x[L.parent[p]];
+					}
+					L.x[i] += sum;
+				}
+			});
+
+			smooth(L, smoothingSteps, false);
+		}
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef NODESTORE_H
+#define NODESTORE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <new>
+#include <cstddef>
+
+using namespace std;
+using namespace glm;
+
+// allocator handing out cache-line aligned blocks so every node array starts on its own line
+template <typename T, size_t Align = 64>
+struct AlignedAllocator {
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, Align> other;
+	};
+
+	AlignedAllocator() noexcept {}
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Align>&) noexcept {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(Align)));
+	}
+
+	void deallocate(T* p, size_t) noexcept {
+		::operator delete(p, align_val_t(Align));
+	}
+
+	template <typename U>
+	bool operator==(const AlignedAllocator<U, Align>&) const noexcept { return true; }
+
+	template <typename U>
+	bool operator!=(const AlignedAllocator<U, Align>&) const noexcept { return false; }
+};
+
+template <typename T>
+using aligned_vector = vector<T, AlignedAllocator<T>>;
+
+struct PointMass {
+    vec3 Position;
+	vec3 previousPosition;
+	vec3 forces;
+	vec3 previousForces;
+
+    float mass;
+
+    PointMass(vec3 pos, float m) {
+        Position = pos;
+    	previousPosition = pos;
+
+    	forces = vec3(0, 0, 0);
+    	previousForces = vec3(0, 0, 0);
+        mass = m;
+    }
+};
+
+// view of a single node inside a NodeStore with the field names of PointMass, so loops over
+// vector<PointMass> port by name. the view is returned by value: iterate with auto or auto&&, not
+// auto&, and the mass is read only through it, setMass keeps invMass in step
+template <typename T>
+struct BasicPointMassRef {
+	vec<3, T>& Position;
+	vec<3, T>& previousPosition;
+	vec<3, T>& forces;
+	const T& mass;
+};
+
+// the same view of a const NodeStore, for the passes that only read the nodes
+template <typename T>
+struct BasicConstPointMassRef {
+	const vec<3, T>& Position;
+	const vec<3, T>& previousPosition;
+	const vec<3, T>& forces;
+	const T& mass;
+};
+
+// nodes per chunk for the solvers' per-node passes
+const size_t SOLVER_GRAIN = 4096;
+
+// structure-of-arrays storage for a cage's point masses. the hot loops (forces, springs, verlet)
+// only ever touch two or three of these arrays at a time, so keeping them apart means
+// every cache line pulled in is actually used. T is the scalar the nodes are stored in
+template <typename T>
+class BasicNodeStore {
+	public:
+		typedef vec<3, T> vec_type;
+
+		aligned_vector<vec_type> position;
+		aligned_vector<vec_type> previous;
+		aligned_vector<vec_type> force;
+		aligned_vector<T> mass;
+		aligned_vector<T> invMass;
+
+		class iterator {
+			public:
+				iterator(BasicNodeStore* store, size_t i) : store(store), i(i) {}
+
+				BasicPointMassRef<T> operator*() const { return (*store)[i]; }
+				iterator& operator++() { ++i; return *this; }
+				bool operator==(const iterator& o) const { return i == o.i; }
+				bool operator!=(const iterator& o) const { return i != o.i; }
+
+			private:
+				BasicNodeStore* store;
+				size_t i;
+		};
+
+		class const_iterator {
+			public:
+				const_iterator(const BasicNodeStore* store, size_t i) : store(store), i(i) {}
+
+				BasicConstPointMassRef<T> operator*() const { return (*store)[i]; }
+				const_iterator& operator++() { ++i; return *this; }
+				bool operator==(const const_iterator& o) const { return i == o.i; }
+				bool operator!=(const const_iterator& o) const { return i != o.i; }
+
+			private:
+				const BasicNodeStore* store;
+				size_t i;
+		};
+
+		size_t size() const {
+			return position.size();
+		}
+
+		bool empty() const {
+			return position.empty();
+		}
+
+		void clear() {
+			position.clear();
+			previous.clear();
+			force.clear();
+			mass.clear();
+			invMass.clear();
+		}
+
+		void resize(size_t n) {
+			position.resize(n, vec_type(0));
+			previous.resize(n, vec_type(0));
+			force.resize(n, vec_type(0));
+			mass.resize(n, T(1));
+			invMass.resize(n, T(1));
+		}
+
+		void push_back(const PointMass& p) {
+			position.push_back(vec_type(p.Position));
+			previous.push_back(vec_type(p.previousPosition));
+			force.push_back(vec_type(p.forces));
+			mass.push_back(T(p.mass));
+			invMass.push_back(p.mass > 0.0f ? T(1) / T(p.mass) : T(0));
+		}
+
+		void assign(const vector<PointMass>& nodes) {
+			clear();
+			position.reserve(nodes.size());
+			previous.reserve(nodes.size());
+			force.reserve(nodes.size());
+			mass.reserve(nodes.size());
+			invMass.reserve(nodes.size());
+			for (auto& p : nodes) {
+				push_back(p);
+			}
+		}
+
+		// renumbers the nodes so new node i is old node order[i]
+		void permute(const vector<unsigned int>& order) {
+			BasicNodeStore old;
+			old.position.swap(position);
+			old.previous.swap(previous);
+			old.force.swap(force);
+			old.mass.swap(mass);
+			old.invMass.swap(invMass);
+
+			resize(order.size());
+			for (size_t i = 0; i < order.size(); ++i) {
+				position[i] = old.position[order[i]];
+				previous[i] = old.previous[order[i]];
+				force[i] = old.force[order[i]];
+				mass[i] = old.mass[order[i]];
+				invMass[i] = old.invMass[order[i]];
+			}
+		}
+
+		void setMass(size_t i, T m) {
+			mass[i] = m;
+			invMass[i] = m > T(0) ? T(1) / m : T(0);
+		}
+
+		BasicPointMassRef<T> operator[](size_t i) {
+			return BasicPointMassRef<T>{ position[i], previous[i], force[i], mass[i] };
+		}
+
+		BasicConstPointMassRef<T> operator[](size_t i) const {
+			return BasicConstPointMassRef<T>{ position[i], previous[i], force[i], mass[i] };
+		}
+
+		iterator begin() { return iterator(this, 0); }
+		iterator end() { return iterator(this, size()); }
+		const_iterator begin() const { return const_iterator(this, 0); }
+		const_iterator end() const { return const_iterator(this, size()); }
+};
+
+// the float store the real time solvers work on
+typedef BasicNodeStore<float> NodeStore;
+typedef BasicPointMassRef<float> PointMassRef;
+typedef BasicConstPointMassRef<float> ConstPointMassRef;
+
+// integer lattice coordinate of every node of a lattice cage, node i sits at coord[i] of a
+// dims.x * dims.y * dims.z grid, spacing apart at rest. empty for cages that aren't a lattice
+struct NodeGrid {
+	vector<ivec3> coord;
+	ivec3 dims = ivec3(0);
+	float spacing = 1.0f;
+
+	bool empty() const {
+		return coord.empty();
+	}
+};
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+using namespace glm;
+
+#include "cage.h"
+#include "timestep.h"
+#include "taskgraph.h"
+#include "snapshot.h"
+#include "contact.h"
+
+// one tick of every cage in cages as tasks of graph, the cages side by side, then contacts between
+// them when given. returns the task ending each cage's tick, the contact task for all of them with
+// contacts. cages has to stay around until the graph has run
+inline vector<TaskGraph::TaskId> addTickTasks(TaskGraph& graph, const vector<Cage*>& cages, vec3 inputForce,
+											  const FixedStepper& stepper, float floorY = 0.0f,
+											  CageContacts* contacts = nullptr) {
+	vector<TaskGraph::TaskId> ends;
+	for (size_t k = 0; k < cages.size(); ++k) {
+		Cage& cage = *cages[k];
+		// the cage adds substeps when its springs need them, stepper.substeps is the floor
+		int substeps = std::max(stepper.substeps, cage.substepsFor(stepper.dt));
+		ends.push_back(cage.addTickTasks(graph, "cage " + to_string(k), inputForce, stepper.dt, substeps, floorY));
+	}
+	if (contacts && cages.size() > 1) {
+		TaskGraph::TaskId resolved = graph.add("contacts", [contacts, &cages] {
+			contacts->update(cages);
+		}, ends);
+		ends.assign(cages.size(), resolved);
+	}
+	return ends;
+}
+
+// steps cages on a thread of its own at the stepper's rate, so a slow tick doesn't hold up a frame
+// and vsync doesn't hold up physics. after every tick it publishes a snapshot the render thread
+// picks up with latest(), neither side waits for the other. from start() to stop() the cages
+// belong to the physics thread, the render thread only uploads and draws them (see
+// Cage::uploadMesh(const vec3*)) and passes input in through setInput
+class PhysicsThread {
+	public:
+		float floorY = 0.0f;
+		// contacts between the cages, none when null. set before start
+		CageContacts* contacts = nullptr;
+
+		PhysicsThread(const vector<Cage*>& cages, const FixedStepper& stepper) : cages(cages), stepper(stepper) {
+			epoch = clock::now();
+			moved.assign(cages.size(), 0);
+		}
+
+		~PhysicsThread() {
+			stop();
+		}
+
+		PhysicsThread(const PhysicsThread&) = delete;
+		PhysicsThread& operator=(const PhysicsThread&) = delete;
+
+		void start() {
+			if (worker.joinable()) {
+				return;
+			}
+			running.store(true);
+			worker = thread([this] { loop(); });
+		}
+
+		void stop() {
+			running.store(false);
+			if (worker.joinable()) {
+				worker.join();
+			}
+		}
+
+		// render thread. the arrow key input for the ticks to come
+		void setInput(vec3 inputForce) {
+			input.back() = inputForce;
+			input.publish();
+		}
+
+		// render thread. the newest snapshot, tick is 0 until the first is out
+		const PhysicsSnapshot& latest() {
+			return snapshots.read();
+		}
+
+		// seconds on the clock snapshots are stamped with
+		double now() const {
+			return chrono::duration<double>(clock::now() - epoch).count();
+		}
+
+		// prints the task timings of the next tick
+		void dumpTimings() {
+			dumpRequested.store(true);
+		}
+
+	private:
+		typedef chrono::steady_clock clock;
+
+		vector<Cage*> cages;
+		FixedStepper stepper;
+		clock::time_point epoch;
+
+		thread worker;
+		atomic<bool> running{ false };
+		atomic<bool> dumpRequested{ false };
+		TripleBuffer<vec3> input;
+		TripleBuffer<PhysicsSnapshot> snapshots;
+		TaskGraph graph;
+		unsigned long ticks = 0;
+		// ticks run by the last snapshot published
+		unsigned long publishedTicks = 0;
+		// per cage, the last tick that moved it
+		vector<unsigned long> moved;
+
+		void loop() {
+			double last = now();
+			while (running.load()) {
+				double frameStart = now();
+				int count = stepper.advance(frameStart - last);
+				last = frameStart;
+
+				if (count == 0) {
+					// sleep until the next tick is due
+					this_thread::sleep_for(chrono::duration<double>((1.0f - stepper.alpha()) * stepper.dt));
+					continue;
+				}
+
+				vec3 inputForce = input.read();
+				for (int i = 0; i < count; ++i) {
+					graph.clear();
+					addTickTasks(graph, cages, inputForce, stepper, floorY, contacts);
+					graph.run();
+					++ticks;
+					for (size_t k = 0; k < cages.size(); ++k) {
+						if (!cages[k]->restedLastTick()) {
+							moved[k] = ticks;
+						}
+					}
+				}
+				if (dumpRequested.exchange(false)) {
+					graph.dumpTimings(cout);
+				}
+				publish(now() - frameStart);
+			}
+		}
+
+		// copies the nodes of the cages that moved since the slot last held them. a sleeping cage is
+		// copied at most once per slot, after the tick it fell asleep on
+		void publish(double tickSeconds) {
+			PhysicsSnapshot& s = snapshots.back();
+			s.start.resize(cages.size());
+			s.end.resize(cages.size());
+			s.asleep.resize(cages.size());
+			s.copied.resize(cages.size(), 0);
+			for (size_t k = 0; k < cages.size(); ++k) {
+				s.asleep[k] = moved[k] <= publishedTicks;
+				if (s.copied[k] == 0 || s.copied[k] < moved[k]) {
+					cages[k]->copyTick(s.start[k], s.end[k]);
+					s.copied[k] = ticks;
+				}
+			}
+			s.time = now();
+			s.dt = stepper.dt;
+			s.tick = ticks;
+			s.tickSeconds = tickSeconds;
+			snapshots.publish();
+			publishedTicks = ticks;
+		}
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <glm/glm.hpp>
+
+#include <type_traits>
+
+using namespace std;
+using namespace glm;
+
+// scalar types a cage runs on. Real is what the node state is stored in, Accum is what forces are
+// summed and the verlet update is done in before the result is rounded back to Real
+template <typename R, typename A>
+struct Precision {
+	typedef R Real;
+	typedef A Accum;
+
+	// the implicit, xpbd and projective solvers and the simd kernel only exist for this one
+	static const bool realTime = is_same<R, float>::value && is_same<A, float>::value;
+};
+
+// real time
+typedef Precision<float, float> FloatPrecision;
+// reference and offline runs
+typedef Precision<double, double> DoublePrecision;
+// float storage and upload, spring forces and integration in double
+typedef Precision<float, double> MixedPrecision;
+
+#endif
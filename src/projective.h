@@ -0,0 +1,478 @@
+#ifndef PROJECTIVE_H
+#define PROJECTIVE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "springkernel.h"
+#include "reorder.h"
+#include "chebyshev.h"
+
+// floor contact weight, relative to the node's own diagonal entry
+const double PD_CONTACT_WEIGHT = 100.0;
+
+// how ProjectiveSolver runs the global step. cholesky solves it exactly with a cached factor,
+// jacobi does one sweep per iteration fused with the local step and never factors anything
+enum PdGlobalSolve {
+	CHOLESKY_SOLVE,
+	JACOBI_SOLVE
+};
+
+// projective dynamics (bouaziz et al. 14, liu et al. 13 for springs) for a cage. each iteration
+// projects every spring onto its rest length (local step, per node in parallel over the incidence
+// index) and then solves
+//     (M / h^2 + sum k (ea - eb)(ea - eb)^T) x = M / h^2 y + sum k (ea - eb) p
+// (global step). the matrix only depends on the topology, the masses and h, the same for x, y and z,
+// so it's cholesky factored once, in nested dissection order, and every iteration is two
+// triangular solves.
+// nodes headed into the floor get a contact term pulling their y onto it. that only touches the
+// diagonal of the y system, so y gets a second factor with the same pattern, refactored
+// numerically whenever the contact set changes.
+// the jacobi global step converges much slower than the exact one, it's meant to run under
+// chebyshev acceleration, with the spectral radius estimated whenever the matrix changes
+class ProjectiveSolver {
+	public:
+		int iterations = 10;
+		PdGlobalSolve globalSolve = CHOLESKY_SOLVE;
+
+		// jacobi only
+		bool accelerate = true;
+		ChebyshevAccelerator chebyshev;
+		// |D (G(x) - x)| after each iteration of the last jacobi step, D the matrix diagonal
+		vector<float> residuals;
+
+		// advances pts by h. pts.force must hold the external forces, floorY is in local coordinates
+		void step(NodeStore& pts, const CageTopology& topo, float h, float floorY) {
+			if (globalSolve == JACOBI_SOLVE) {
+				jacobiStep(pts, topo, h, floorY);
+				return;
+			}
+
+			const size_t n = pts.size();
+			if (&topo != builtFor || topo.revision != builtRevision) {
+				analyze(pts, topo);
+			}
+			if (h != builtH || !equal(pts.mass.begin(), pts.mass.end(), builtMass.begin(), builtMass.end())) {
+				assemble(pts, topo, h);
+			}
+
+			const float invH2 = 1.0f / (h * h);
+			ThreadPool& pool = ThreadPool::shared();
+
+			// inertial target y, x starts there. contacts are the nodes it would take through the floor
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 p = pts.position[i];
+					inertia[i] = p + (p - pts.previous[i]) + pts.force[i] * pts.invMass[i] * (h * h);
+					contact[row[i]] = inertia[i].y < floorY;
+					pts.previous[i] = p;
+					pts.position[i] = inertia[i];
+				}
+			});
+			updateContacts();
+
+			for (int it = 0; it < iterations; ++it) {
+				// local projections gathered straight into the right hand side, in factor order
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t r = begin; r < end; ++r) {
+						const unsigned int i = order[r];
+						const vec3 xi = pts.position[i];
+						vec3 b = pts.mass[i] * invH2 * inertia[i];
+						for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+							vec3 x = xi - pts.position[topo.neighbor[e]];
+							float len2 = dot(x, x);
+							if (len2 > SPRING_MIN_LENGTH2) {
+								b += (topo.incidentK[e] * topo.incidentRestLength[e] / sqrt(len2)) * x;
+							}
+						}
+						solution[r] = dvec3(b);
+						vertical[r] = contact[r] ? b.y + contactWeight[r] * floorY : b.y;
+					}
+				});
+
+				substitute(Lx, solution);
+				if (numContacts > 0) {
+					substitute(contactLx, vertical);
+				}
+
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t r = begin; r < end; ++r) {
+						vec3 x = vec3(solution[r]);
+						if (numContacts > 0) {
+							x.y = (float)vertical[r];
+						}
+						x.y = std::max(x.y, floorY);
+						pts.position[order[r]] = x;
+					}
+				});
+			}
+		}
+
+	private:
+		// order[r] = node in factor row r, row[i] = factor row of node i
+		vector<unsigned int> order;
+		vector<unsigned int> row;
+
+		// upper triangle of the permuted system matrix, column by column with the diagonal last
+		vector<unsigned int> Ap;
+		vector<unsigned int> Ai;
+		vector<double> Ax;
+
+		// L column by column with the diagonal first, and the elimination tree. the factorization
+		// runs in double in factorLx, the solves stream a float copy at half the bandwidth
+		vector<size_t> Lp;
+		vector<unsigned int> Li;
+		vector<float> Lx;
+		vector<int> parent;
+		vector<double> factorLx;
+		// factor of the y system with the contact terms, same pattern as Lx
+		vector<float> contactLx;
+
+		// per factor row
+		vector<unsigned char> contact;
+		vector<unsigned char> factoredContact;
+		vector<double> contactWeight;
+		size_t numContacts = 0;
+
+		aligned_vector<vec3> inertia;
+		vector<dvec3> solution;
+		vector<double> vertical;
+
+		// scratch for reach and the numeric factorization
+		vector<double> work;
+		vector<unsigned int> pattern;
+		vector<unsigned int> path;
+		vector<size_t> flag;
+
+		// what the factors were built from
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+		float builtH = 0.0f;
+		vector<float> builtMass;
+
+		// jacobi diagonal, the two iterates before the current one, and what they were built from
+		vector<float> jacobiDiagonal;
+		aligned_vector<vec3> olderIterate;
+		aligned_vector<vec3> nextIterate;
+		const CageTopology* jacobiFor = nullptr;
+		unsigned int jacobiRevision = 0;
+		float jacobiH = 0.0f;
+		float jacobiRelaxation = 0.0f;
+		vector<float> jacobiMass;
+
+		void jacobiStep(NodeStore& pts, const CageTopology& topo, float h, float floorY) {
+			const size_t n = pts.size();
+			if (&topo != jacobiFor || topo.revision != jacobiRevision || h != jacobiH
+				|| chebyshev.relaxation != jacobiRelaxation
+				|| !equal(pts.mass.begin(), pts.mass.end(), jacobiMass.begin(), jacobiMass.end())) {
+				prepareJacobi(pts, topo, h);
+			}
+
+			const float invH2 = 1.0f / (h * h);
+			ThreadPool& pool = ThreadPool::shared();
+
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 p = pts.position[i];
+					inertia[i] = p + (p - pts.previous[i]) + pts.force[i] * pts.invMass[i] * (h * h);
+					pts.previous[i] = p;
+					pts.position[i] = inertia[i];
+					olderIterate[i] = inertia[i];
+				}
+			});
+
+			chebyshev.begin(iterations);
+			residuals.clear();
+			for (int it = 0; it < iterations; ++it) {
+				const float w = accelerate ? chebyshev.next() : 1.0f;
+				const vec3* x = pts.position.data();
+
+				// local projections and one jacobi sweep of the global system, per node
+				double residual = pool.parallelReduce(0, n, SOLVER_GRAIN, 0.0, [&](size_t begin, size_t end) {
+					double sum = 0.0;
+					for (size_t i = begin; i < end; ++i) {
+						const vec3 xi = x[i];
+						vec3 b = pts.mass[i] * invH2 * inertia[i];
+						for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+							const vec3 xj = x[topo.neighbor[e]];
+							vec3 d = xi - xj;
+							float len2 = dot(d, d);
+							if (len2 > SPRING_MIN_LENGTH2) {
+								d *= topo.incidentRestLength[e] / sqrt(len2);
+							}
+							b += topo.incidentK[e] * (xj + d);
+						}
+
+						const float diagonal = jacobiDiagonal[i];
+						vec3 update = b / diagonal;
+						if (inertia[i].y < floorY) {
+							float weight = (float)PD_CONTACT_WEIGHT * diagonal;
+							update.y = (b.y + weight * floorY) / (diagonal + weight);
+						}
+
+						vec3 r = diagonal * (update - xi);
+						sum += dot(r, r);
+
+						vec3 next = chebyshev.blend(w, xi, update, olderIterate[i]);
+						next.y = std::max(next.y, floorY);
+						nextIterate[i] = next;
+					}
+					return sum;
+				});
+				residuals.push_back((float)sqrt(residual));
+
+				// x(k - 1) <- x(k) <- x(k + 1)
+				olderIterate.swap(pts.position);
+				pts.position.swap(nextIterate);
+			}
+		}
+
+		// diagonal of the system matrix and the spectral radius of the relaxed jacobi iteration
+		void prepareJacobi(const NodeStore& pts, const CageTopology& topo, float h) {
+			const size_t n = pts.size();
+			const float invH2 = 1.0f / (h * h);
+			jacobiDiagonal.resize(n);
+			for (size_t i = 0; i < n; ++i) {
+				float diagonal = pts.mass[i] * invH2;
+				for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+					diagonal += topo.incidentK[e];
+				}
+				jacobiDiagonal[i] = diagonal;
+			}
+
+			// x <- (1 - gamma) x + gamma D^-1 (offdiagonal) x
+			const float gamma = chebyshev.relaxation;
+			chebyshev.spectralRadius = estimateSpectralRadius(n, [&](const vector<float>& in, vector<float>& out) {
+				for (size_t i = 0; i < n; ++i) {
+					float sum = 0.0f;
+					for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+						sum += topo.incidentK[e] * in[topo.neighbor[e]];
+					}
+					out[i] = (1.0f - gamma) * in[i] + gamma * sum / jacobiDiagonal[i];
+				}
+			});
+
+			inertia.resize(n);
+			olderIterate.resize(n);
+			nextIterate.resize(n);
+
+			jacobiFor = &topo;
+			jacobiRevision = topo.revision;
+			jacobiH = h;
+			jacobiRelaxation = gamma;
+			jacobiMass.assign(pts.mass.begin(), pts.mass.end());
+		}
+
+		// fill reducing ordering, matrix pattern, elimination tree and the pattern of L
+		void analyze(const NodeStore& pts, const CageTopology& topo) {
+			const size_t n = pts.size();
+			order = ndOrder(pts.position, topo);
+			row.resize(n);
+			for (size_t r = 0; r < n; ++r) {
+				row[order[r]] = (unsigned int)r;
+			}
+
+			Ap.assign(1, 0);
+			Ai.clear();
+			for (size_t r = 0; r < n; ++r) {
+				unsigned int i = order[r];
+				size_t start = Ai.size();
+				for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+					unsigned int c = row[topo.neighbor[e]];
+					if (c < r) {
+						Ai.push_back(c);
+					}
+				}
+				sort(Ai.begin() + start, Ai.end());
+				Ai.erase(unique(Ai.begin() + start, Ai.end()), Ai.end());
+				Ai.push_back((unsigned int)r);
+				Ap.push_back((unsigned int)Ai.size());
+			}
+			Ax.assign(Ai.size(), 0.0);
+
+			// elimination tree, with path compression over the ancestors
+			parent.assign(n, -1);
+			vector<int> ancestor(n, -1);
+			for (size_t k = 0; k < n; ++k) {
+				for (unsigned int p = Ap[k]; p < Ap[k + 1] - 1; ++p) {
+					int i = (int)Ai[p];
+					while (i != -1 && i < (int)k) {
+						int up = ancestor[i];
+						ancestor[i] = (int)k;
+						if (up == -1) {
+							parent[i] = (int)k;
+						}
+						i = up;
+					}
+				}
+			}
+
+			// column counts of L from the row patterns
+			flag.assign(n, 0);
+			pattern.resize(n);
+			path.resize(n);
+			vector<size_t> columnCount(n, 1);
+			for (size_t k = 0; k < n; ++k) {
+				for (size_t p = reach(k); p < n; ++p) {
+					++columnCount[pattern[p]];
+				}
+			}
+			Lp.assign(n + 1, 0);
+			for (size_t k = 0; k < n; ++k) {
+				Lp[k + 1] = Lp[k] + columnCount[k];
+			}
+			Li.resize(Lp[n]);
+			Lx.resize(Lp[n]);
+			factorLx.resize(Lp[n]);
+			contactLx.resize(Lp[n]);
+
+			contact.assign(n, 0);
+			factoredContact.assign(n, 0);
+			contactWeight.assign(n, 0.0);
+			numContacts = 0;
+			inertia.resize(n);
+			solution.resize(n);
+			vertical.resize(n);
+			work.assign(n, 0.0);
+
+			builtFor = &topo;
+			builtRevision = topo.revision;
+			builtH = 0.0f;
+			builtMass.clear();
+		}
+
+		// system matrix values for the current masses and h, then the shared factor
+		void assemble(const NodeStore& pts, const CageTopology& topo, float h) {
+			const size_t n = pts.size();
+			const double invH2 = 1.0 / ((double)h * h);
+			fill(Ax.begin(), Ax.end(), 0.0);
+			for (size_t r = 0; r < n; ++r) {
+				unsigned int i = order[r];
+				double& diagonal = Ax[Ap[r + 1] - 1];
+				diagonal += pts.mass[i] * invH2;
+				for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+					unsigned int c = row[topo.neighbor[e]];
+					diagonal += topo.incidentK[e];
+					if (c < r) {
+						size_t slot = lower_bound(Ai.begin() + Ap[r], Ai.begin() + Ap[r + 1] - 1, c) - Ai.begin();
+						Ax[slot] -= topo.incidentK[e];
+					}
+				}
+			}
+			for (size_t r = 0; r < n; ++r) {
+				contactWeight[r] = PD_CONTACT_WEIGHT * Ax[Ap[r + 1] - 1];
+			}
+
+			factorize(Lx, false);
+			// forces the contact factor to be redone for the new matrix
+			factoredContact.assign(n, 0);
+			numContacts = 0;
+
+			builtH = h;
+			builtMass.assign(pts.mass.begin(), pts.mass.end());
+		}
+
+		// refactors the y system if this step's contacts differ from the factored ones
+		void updateContacts() {
+			if (contact == factoredContact) {
+				return;
+			}
+			factoredContact = contact;
+			numContacts = count(contact.begin(), contact.end(), 1);
+			if (numContacts > 0) {
+				factorize(contactLx, true);
+			}
+		}
+
+		// columns of row k of L: everything reached from A's column k up the elimination tree,
+		// left in pattern[top .. n) in topological order
+		size_t reach(size_t k) {
+			const size_t n = parent.size();
+			size_t top = n;
+			flag[k] = k + 1;
+			for (unsigned int p = Ap[k]; p < Ap[k + 1] - 1; ++p) {
+				int i = (int)Ai[p];
+				size_t len = 0;
+				for (; flag[i] != k + 1; i = parent[i]) {
+					path[len++] = (unsigned int)i;
+					flag[i] = k + 1;
+				}
+				while (len > 0) {
+					pattern[--top] = path[--len];
+				}
+			}
+			return top;
+		}
+
+		// up-looking cholesky, row k of L solved against the rows above it. withContacts adds the
+		// contact weight to the diagonal of the contact rows
+		void factorize(vector<float>& out, bool withContacts) {
+			const size_t n = parent.size();
+			vector<double>& L = factorLx;
+			vector<size_t> used(Lp.begin(), Lp.end() - 1);
+			fill(flag.begin(), flag.end(), 0);
+
+			for (size_t k = 0; k < n; ++k) {
+				size_t top = reach(k);
+				for (unsigned int p = Ap[k]; p < Ap[k + 1]; ++p) {
+					work[Ai[p]] = Ax[p];
+				}
+				double d = work[k];
+				if (withContacts && contact[k]) {
+					d += contactWeight[k];
+				}
+				work[k] = 0.0;
+
+				for (size_t p = top; p < n; ++p) {
+					unsigned int i = pattern[p];
+					double lki = work[i] / L[Lp[i]];
+					work[i] = 0.0;
+					for (size_t q = Lp[i] + 1; q < used[i]; ++q) {
+						work[Li[q]] -= L[q] * lki;
+					}
+					d -= lki * lki;
+					size_t q = used[i]++;
+					Li[q] = (unsigned int)k;
+					L[q] = lki;
+				}
+
+				// only a node with no mass and no springs can get here
+				size_t q = used[k]++;
+				Li[q] = (unsigned int)k;
+				L[q] = sqrt(std::max(d, 1e-12));
+			}
+
+			copy(L.begin(), L.end(), out.begin());
+		}
+
+		// z <- (L L^T)^-1 z
+		template <typename T>
+		void substitute(const vector<float>& L, vector<T>& z) {
+			const size_t n = z.size();
+			for (size_t j = 0; j < n; ++j) {
+				T x = z[j] / (double)L[Lp[j]];
+				z[j] = x;
+				for (size_t q = Lp[j] + 1; q < Lp[j + 1]; ++q) {
+					z[Li[q]] -= (double)L[q] * x;
+				}
+			}
+			for (size_t j = n; j-- > 0;) {
+				T x = z[j];
+				for (size_t q = Lp[j] + 1; q < Lp[j + 1]; ++q) {
+					x -= (double)L[q] * z[Li[q]];
+				}
+				z[j] = x / (double)L[Lp[j]];
+			}
+		}
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+using namespace glm;
+
+#include "topology.h"
+
+// node numberings a cage can be renumbered into. all return order[newIndex] = oldIndex
+enum NodeOrdering {
+	MORTON_ORDER,   // z-order curve over the positions, Cage::reorder passes the lattice's at rest
+	RCM_ORDER,      // reverse cuthill-mckee over the spring graph, minimizes index bandwidth
+	ND_ORDER        // nested dissection over the spring graph, minimizes cholesky fill
+};
+
+// parts at most this big aren't dissected any further
+const size_t ND_LEAF_SIZE = 64;
+
+// spreads the low 10 bits of v so there are two zero bits between each
+inline uint32_t mortonSpread(uint32_t v) {
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+inline vector<unsigned int> mortonOrder(const aligned_vector<vec3>& position) {
+	size_t n = position.size();
+	vector<unsigned int> order(n);
+	if (n == 0) {
+		return order;
+	}
+
+	vec3 lo = position[0];
+	vec3 hi = position[0];
+	for (auto& p : position) {
+		lo = min(lo, p);
+		hi = max(hi, p);
+	}
+	vec3 extent = max(hi - lo, vec3(1e-6f));
+	vec3 scale = vec3(1023.0f) / extent;
+
+	vector<uint32_t> code(n);
+	for (size_t i = 0; i < n; ++i) {
+		uvec3 q = uvec3((position[i] - lo) * scale + 0.5f);
+		code[i] = mortonSpread(q.x) | (mortonSpread(q.y) << 1) | (mortonSpread(q.z) << 2);
+		order[i] = (unsigned int)i;
+	}
+
+	stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		return code[a] < code[b];
+	});
+	return order;
+}
+
+inline vector<unsigned int> rcmOrder(size_t numNodes, const vector<Spring>& springs) {
+	// adjacency in csr form
+	vector<unsigned int> offsets(numNodes + 1, 0);
+	for (auto& s : springs) {
+		++offsets[s.v0 + 1];
+		++offsets[s.v1 + 1];
+	}
+	for (size_t i = 1; i <= numNodes; ++i) {
+		offsets[i] += offsets[i - 1];
+	}
+	vector<unsigned int> adj(offsets[numNodes]);
+	vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+	for (auto& s : springs) {
+		adj[cursor[s.v0]++] = s.v1;
+		adj[cursor[s.v1]++] = s.v0;
+	}
+
+	auto degree = [&](unsigned int i) { return offsets[i + 1] - offsets[i]; };
+
+	vector<unsigned int> order;
+	order.reserve(numNodes);
+	vector<bool> visited(numNodes, false);
+
+	// nodes sorted by degree so each component starts from a low degree (peripheral) node
+	vector<unsigned int> byDegree(numNodes);
+	for (size_t i = 0; i < numNodes; ++i) {
+		byDegree[i] = (unsigned int)i;
+	}
+	stable_sort(byDegree.begin(), byDegree.end(), [&](unsigned int a, unsigned int b) {
+		return degree(a) < degree(b);
+	});
+
+	vector<unsigned int> level;
+	for (unsigned int root : byDegree) {
+		if (visited[root]) {
+			continue;
+		}
+
+		// breadth first, visiting each node's neighbours in increasing degree
+		size_t head = order.size();
+		order.push_back(root);
+		visited[root] = true;
+		while (head < order.size()) {
+			unsigned int u = order[head++];
+			level.clear();
+			for (unsigned int e = offsets[u]; e < offsets[u + 1]; ++e) {
+				if (!visited[adj[e]]) {
+					visited[adj[e]] = true;
+					level.push_back(adj[e]);
+				}
+			}
+			stable_sort(level.begin(), level.end(), [&](unsigned int a, unsigned int b) {
+				return degree(a) < degree(b);
+			});
+			order.insert(order.end(), level.begin(), level.end());
+		}
+	}
+
+	reverse(order.begin(), order.end());
+	return order;
+}
+
+// splits nodes at the median of their widest axis, moves the nodes of the upper half that touch the
+// lower half into a separator, orders both halves recursively and the separator last. part holds
+// the label of the part each node is in, so the separator test stays local to this part
+inline void dissect(vector<unsigned int>& nodes, const aligned_vector<vec3>& position, const CageTopology& topo,
+	vector<unsigned int>& part, unsigned int& nextPart, vector<unsigned int>& order) {
+	if (nodes.size() <= ND_LEAF_SIZE) {
+		order.insert(order.end(), nodes.begin(), nodes.end());
+		return;
+	}
+
+	vec3 lo = position[nodes[0]];
+	vec3 hi = position[nodes[0]];
+	for (unsigned int i : nodes) {
+		lo = min(lo, position[i]);
+		hi = max(hi, position[i]);
+	}
+	vec3 extent = hi - lo;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+	// split between two layers rather than through one, lattices have many equal coordinates
+	size_t mid = nodes.size() / 2;
+	auto below = [&](unsigned int a, unsigned int b) {
+		return position[a][axis] != position[b][axis] ? position[a][axis] < position[b][axis] : a < b;
+	};
+	sort(nodes.begin(), nodes.end(), below);
+	float split = position[nodes[mid]][axis];
+	size_t first = mid;
+	while (first > 0 && position[nodes[first - 1]][axis] == split) {
+		--first;
+	}
+	size_t last = mid;
+	while (last < nodes.size() && position[nodes[last]][axis] == split) {
+		++last;
+	}
+	mid = first > 0 && (mid - first <= last - mid || last == nodes.size()) ? first : last;
+	// every node on one layer, more than a leaf's worth of them at one point: there's nothing to
+	// split, the part stays whole
+	if (mid == 0 || mid == nodes.size() || extent[axis] == 0.0f) {
+		order.insert(order.end(), nodes.begin(), nodes.end());
+		return;
+	}
+
+	unsigned int lower = nextPart++;
+	unsigned int upper = nextPart++;
+	for (size_t j = 0; j < nodes.size(); ++j) {
+		part[nodes[j]] = j < mid ? lower : upper;
+	}
+
+	vector<unsigned int> left(nodes.begin(), nodes.begin() + mid);
+	vector<unsigned int> right;
+	vector<unsigned int> separator;
+	for (size_t j = mid; j < nodes.size(); ++j) {
+		unsigned int i = nodes[j];
+		bool touches = false;
+		for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1] && !touches; ++e) {
+			touches = part[topo.neighbor[e]] == lower;
+		}
+		(touches ? separator : right).push_back(i);
+	}
+	nodes.clear();
+	nodes.shrink_to_fit();
+
+	dissect(left, position, topo, part, nextPart, order);
+	dissect(right, position, topo, part, nextPart, order);
+	order.insert(order.end(), separator.begin(), separator.end());
+}
+
+inline vector<unsigned int> ndOrder(const aligned_vector<vec3>& position, const CageTopology& topo) {
+	size_t n = position.size();
+	vector<unsigned int> nodes(n);
+	for (size_t i = 0; i < n; ++i) {
+		nodes[i] = (unsigned int)i;
+	}
+	vector<unsigned int> part(n, 0);
+	unsigned int nextPart = 1;
+
+	vector<unsigned int> order;
+	order.reserve(n);
+	dissect(nodes, position, topo, part, nextPart, order);
+	return order;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef ROTATION_H
+#define ROTATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cmath>
+
+using namespace std;
+using namespace glm;
+
+// squared turn, in radians, below which a rotation is left alone
+const float ROTATION_EPSILON2 = 1.0e-12f;
+
+// rotational part of A by muller et al. 16: turn q by the axis angle omega that lines its columns up
+// with A's, iterations times. callers warm start q with last step's answer, so the turn is small and
+// q + 1/2 (0, omega) q stands in for the exact rotation and saves the sin and cos. turns below float
+// resolution are dropped, they'd only leave q with tiny components whose squares go subnormal and crawl
+inline quat extractRotation(const mat3& A, quat q, int iterations) {
+	for (int it = 0; it < iterations; ++it) {
+		mat3 R = mat3_cast(q);
+		vec3 omega = (cross(R[0], A[0]) + cross(R[1], A[1]) + cross(R[2], A[2]))
+			/ (fabs(dot(R[0], A[0]) + dot(R[1], A[1]) + dot(R[2], A[2])) + 1.0e-9f);
+		if (dot(omega, omega) < ROTATION_EPSILON2) {
+			break;
+		}
+		q = normalize(q + quat(0.0f, 0.5f * omega) * q);
+	}
+	return q;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef SHAPE_H
+#define SHAPE_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+
+// the part of a cage that only depends on how it was built: the springs, their packed and colored
+// topology, the lattice the nodes sit on and the gpu index buffer drawing the springs. cages hold it
+// through a shared_ptr to const, so any number of cages built the same way share one copy and keep
+// only their nodes to themselves. nothing changes a shape once built, a cage that needs other
+// springs gets another shape
+class CageShape {
+	public:
+		vector<Spring> springs;
+		CageTopology topo;
+		// empty for cages that aren't built on a lattice
+		NodeGrid grid;
+		// the nodes other cages can touch: the lattice's outer layer, or every node of a cage that
+		// isn't a lattice
+		vector<unsigned int> surface;
+
+		CageShape(vector<Spring> springs, size_t numNodes, NodeGrid grid = NodeGrid()) : springs(move(springs)), grid(move(grid)), nodes(numNodes) {
+			topo.build(this->springs, numNodes);
+			findSurface();
+		}
+
+		// frees the index buffer when the last cage lets go on the gl thread. without a current
+		// context, off the gl thread or after the window is gone, it's left to the context's teardown
+		~CageShape() {
+			if (EBO != 0 && glfwGetCurrentContext() != nullptr) {
+				glDeleteBuffers(1, &EBO);
+			}
+		}
+
+		size_t numNodes() const {
+			return nodes;
+		}
+
+		size_t numIndices() const {
+			return 2 * springs.size();
+		}
+
+		// this shape with node order[i] renumbered to i and the springs sorted by their first node.
+		// cages that reorder the same way share the result too
+		shared_ptr<const CageShape> reordered(const vector<unsigned int>& order) const {
+			lock_guard<mutex> guard(derivedLock);
+			for (auto& d : derived) {
+				if (d.first == order) {
+					if (auto shape = d.second.lock()) {
+						return shape;
+					}
+				}
+			}
+
+			vector<unsigned int> newIndex(order.size());
+			for (size_t i = 0; i < order.size(); ++i) {
+				newIndex[order[i]] = (unsigned int)i;
+			}
+
+			vector<Spring> renumbered(springs);
+			for (auto& s : renumbered) {
+				unsigned int a = newIndex[s.v0];
+				unsigned int b = newIndex[s.v1];
+				s.v0 = a < b ? a : b;
+				s.v1 = a < b ? b : a;
+			}
+			stable_sort(renumbered.begin(), renumbered.end(), [](const Spring& a, const Spring& b) {
+				return a.v0 != b.v0 ? a.v0 < b.v0 : a.v1 < b.v1;
+			});
+
+			NodeGrid permuted = grid;
+			if (!grid.empty()) {
+				for (size_t i = 0; i < order.size(); ++i) {
+					permuted.coord[i] = grid.coord[order[i]];
+				}
+			}
+
+			auto shape = make_shared<CageShape>(move(renumbered), nodes, move(permuted));
+			derived.erase(remove_if(derived.begin(), derived.end(), [](const pair<vector<unsigned int>, weak_ptr<const CageShape>>& d) {
+				return d.second.expired();
+			}), derived.end());
+			derived.emplace_back(order, shape);
+			return shape;
+		}
+
+		// the spring index buffer, uploaded by the first cage that draws the shape. gl context only
+		unsigned int indexBuffer() const {
+			if (EBO == 0) {
+				vector<unsigned int> idx;
+				idx.reserve(numIndices());
+				for (auto& s : springs) {
+					idx.push_back(s.v0);
+					idx.push_back(s.v1);
+				}
+				glGenBuffers(1, &EBO);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned int), idx.data(), GL_STATIC_DRAW);
+			}
+			return EBO;
+		}
+
+	private:
+		size_t nodes;
+		mutable unsigned int EBO = 0;
+
+		void findSurface() {
+			for (size_t i = 0; i < nodes; ++i) {
+				if (!grid.empty()) {
+					ivec3 c = grid.coord[i];
+					bool outer = c.x == 0 || c.y == 0 || c.z == 0 ||
+								 c.x + 1 == grid.dims.x || c.y + 1 == grid.dims.y || c.z + 1 == grid.dims.z;
+					if (!outer) {
+						continue;
+					}
+				}
+				surface.push_back((unsigned int)i);
+			}
+		}
+
+		// shapes reordered from this one by a given order, kept while some cage uses them
+		mutable mutex derivedLock;
+		mutable vector<pair<vector<unsigned int>, weak_ptr<const CageShape>>> derived;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef SHAPEMATCH_H
+#define SHAPEMATCH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "rotation.h"
+
+// meshless shape matching (muller et al. 05) in place of the springs. the nodes fall under the external
+// forces, then every cluster finds the rotation (blended with the best fitting linear map when
+// linearBlend is set) that takes its rest shape closest to where its nodes went, and the nodes are
+// pulled stiffness of the way toward where that puts them. a node in several clusters goes toward
+// the average of their goals. the whole cage is one cluster unless clusterCells is set on a lattice
+// cage, then clusters are boxes of that many cells overlapping by half, which lets the cage bend.
+// every node is visited once per cluster it's in and a cluster's sums take one pass because the rest
+// offsets sum to zero, so a step is a few dozen flops per node and there's no stability limit
+class ShapeMatchingSolver {
+	public:
+		// fraction of the way to the goal per step, 1 is rigid
+		float stiffness = 0.5f;
+		// 0 matches rotations only, up to 1 lets the clusters shear and stretch at constant volume
+		float linearBlend = 0.0f;
+		// cells along each edge of a cluster, 0 for one cluster over the whole cage
+		int clusterCells = 0;
+		// rotation refinement iterations per cluster per step
+		int rotationIterations = 3;
+
+		size_t numClusters() const {
+			return cluster.size();
+		}
+
+		// rebuilds the clusters when the topology changed. the rest shape comes from the lattice when
+		// the cage has one, otherwise from the positions at the time
+		void update(const NodeStore& pts, const NodeGrid& grid, const CageTopology& topo) {
+			if (&topo != builtFor || topo.revision != builtRevision || clusterCells != builtCells
+				|| !equal(pts.mass.begin(), pts.mass.end(), builtMass.begin(), builtMass.end())) {
+				build(pts, grid);
+				builtFor = &topo;
+				builtRevision = topo.revision;
+				builtCells = clusterCells;
+				builtMass.assign(pts.mass.begin(), pts.mass.end());
+			}
+		}
+
+		// advances pts by h. pts.force must hold the external forces, floorY is in local coordinates
+		void step(NodeStore& pts, float h, float floorY) {
+			const size_t n = pts.size();
+			ThreadPool& pool = ThreadPool::shared();
+			predicted.resize(n);
+
+			const float h2 = h * h;
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 p = pts.position[i];
+					predicted[i] = p + (p - pts.previous[i]) + pts.force[i] * pts.invMass[i] * h2;
+				}
+			});
+
+			// Apq = sum m (y - c) q^T = sum m y q^T, the rest offsets q of a cluster sum to zero
+			pool.parallelFor(0, cluster.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t c = begin; c < end; ++c) {
+					Cluster& k = cluster[c];
+					vec3 center(0.0f);
+					mat3 Apq(0.0f);
+					for (unsigned int m = k.begin; m < k.end; ++m) {
+						vec3 y = predicted[member[m]] * pts.mass[member[m]];
+						center += y;
+						Apq += outerProduct(y, restOffset[m]);
+					}
+					center /= k.mass;
+
+					k.rotation = extractRotation(Apq, k.rotation, rotationIterations);
+					mat3 T = mat3_cast(k.rotation);
+					if (linearBlend > 0.0f) {
+						mat3 A = Apq * k.invAqq;
+						float det = determinant(A);
+						if (det > 0.0f) {
+							T = linearBlend * (A / cbrt(det)) + (1.0f - linearBlend) * T;
+						}
+					}
+					for (unsigned int m = k.begin; m < k.end; ++m) {
+						goal[m] = center + T * restOffset[m];
+					}
+				}
+			});
+
+			pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					vec3 y = predicted[i];
+					unsigned int first = nodeOffsets[i];
+					unsigned int last = nodeOffsets[i + 1];
+					if (last > first) {
+						vec3 g(0.0f);
+						for (unsigned int m = first; m < last; ++m) {
+							g += goal[nodeMember[m]];
+						}
+						y += stiffness * (g / float(last - first) - y);
+					}
+					if (y.y < floorY) {
+						y.y = floorY;
+						pts.force[i] = vec3(0, -9.8f, 0.0);
+					}
+					pts.previous[i] = pts.position[i];
+					pts.position[i] = y;
+				}
+			});
+		}
+
+	private:
+		// members of a cluster are member[begin .. end), their rest offsets from its center alongside
+		struct Cluster {
+			unsigned int begin;
+			unsigned int end;
+			float mass;
+			mat3 invAqq;
+			quat rotation;
+		};
+
+		vector<Cluster> cluster;
+		aligned_vector<unsigned int> member;
+		aligned_vector<vec3> restOffset;
+		aligned_vector<vec3> goal;
+		// memberships of each node, indices into member
+		aligned_vector<unsigned int> nodeOffsets;
+		aligned_vector<unsigned int> nodeMember;
+		aligned_vector<vec3> predicted;
+
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+		int builtCells = 0;
+		vector<float> builtMass;
+
+		void build(const NodeStore& pts, const NodeGrid& grid) {
+			const size_t n = pts.size();
+			const bool lattice = !grid.empty() && grid.coord.size() == n;
+			vector<vec3> rest(n);
+			for (size_t i = 0; i < n; ++i) {
+				rest[i] = lattice ? vec3(grid.coord[i]) * grid.spacing : pts.position[i];
+			}
+
+			cluster.clear();
+			member.clear();
+			if (lattice && clusterCells > 0) {
+				const ivec3 dims = grid.dims;
+				vector<unsigned int> nodeAt((size_t)dims.x * dims.y * dims.z, 0);
+				for (size_t i = 0; i < n; ++i) {
+					const ivec3& c = grid.coord[i];
+					nodeAt[(c.x * dims.y + c.y) * dims.z + c.z] = (unsigned int)i;
+				}
+
+				// box origins along each axis, half a cluster apart, the last one flush with the far side
+				vector<int> origin[3];
+				for (int a = 0; a < 3; ++a) {
+					int cells = dims[a] - 1;
+					int size = std::min(clusterCells, cells);
+					int stride = std::max(1, size / 2);
+					for (int o = 0; ; o += stride) {
+						int start = std::min(o, cells - size);
+						origin[a].push_back(start);
+						if (start + size >= cells) {
+							break;
+						}
+					}
+				}
+
+				for (int ox : origin[0]) {
+					for (int oy : origin[1]) {
+						for (int oz : origin[2]) {
+							Cluster k;
+							k.begin = (unsigned int)member.size();
+							ivec3 hi = min(ivec3(ox, oy, oz) + clusterCells, dims - 1);
+							for (int x = ox; x <= hi.x; ++x) {
+								for (int y = oy; y <= hi.y; ++y) {
+									for (int z = oz; z <= hi.z; ++z) {
+										member.push_back(nodeAt[(x * dims.y + y) * dims.z + z]);
+									}
+								}
+							}
+							k.end = (unsigned int)member.size();
+							cluster.push_back(k);
+						}
+					}
+				}
+			} else {
+				Cluster k;
+				k.begin = 0;
+				for (size_t i = 0; i < n; ++i) {
+					member.push_back((unsigned int)i);
+				}
+				k.end = (unsigned int)member.size();
+				cluster.push_back(k);
+			}
+
+			restOffset.resize(member.size());
+			goal.resize(member.size());
+			for (Cluster& k : cluster) {
+				k.mass = 0.0f;
+				vec3 center(0.0f);
+				for (unsigned int m = k.begin; m < k.end; ++m) {
+					k.mass += pts.mass[member[m]];
+					center += rest[member[m]] * pts.mass[member[m]];
+				}
+				center /= k.mass;
+
+				mat3 Aqq(0.0f);
+				for (unsigned int m = k.begin; m < k.end; ++m) {
+					restOffset[m] = rest[member[m]] - center;
+					Aqq += outerProduct(restOffset[m] * pts.mass[member[m]], restOffset[m]);
+				}
+				k.invAqq = determinant(Aqq) > 0.0f ? inverse(Aqq) : mat3(1.0f);
+				k.rotation = quat(1.0f, 0.0f, 0.0f, 0.0f);
+			}
+
+			nodeOffsets.assign(n + 1, 0);
+			for (unsigned int i : member) {
+				++nodeOffsets[i + 1];
+			}
+			for (size_t i = 1; i <= n; ++i) {
+				nodeOffsets[i] += nodeOffsets[i - 1];
+			}
+			nodeMember.resize(member.size());
+			vector<unsigned int> cursor(nodeOffsets.begin(), nodeOffsets.end() - 1);
+			for (size_t m = 0; m < member.size(); ++m) {
+				nodeMember[cursor[member[m]]++] = (unsigned int)m;
+			}
+		}
+};
+
+#endif
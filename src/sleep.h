@@ -0,0 +1,79 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "threadpool.h"
+
+// decides when a cage has come to rest. after every tick it looks at each node's kinetic energy
+// and the net force on it, both per unit mass, the force taken from how much the velocity changed
+// over the tick. once every node has stayed under both thresholds for sleepTime the cage is asleep
+// and stops simulating until something wakes it
+class SleepMonitor {
+	public:
+		// 0.5 v^2, a node at 0.045 m/s is at the threshold
+		float energyThreshold = 1e-3f;
+		// |dv / dt|
+		float forceThreshold = 0.2f;
+		// seconds both have to stay under their threshold
+		float sleepTime = 0.5f;
+
+		bool asleep = false;
+
+		// call after a tick of tickDt whose last step was h. returns true on the tick the cage falls asleep.
+		// Store is a BasicNodeStore of any precision
+		template <typename Store>
+		bool update(const Store& pts, float tickDt, float h) {
+			const size_t n = pts.size();
+			if (velocity.size() != n) {
+				velocity.assign(n, vec3(0.0f));
+				calmTime = 0.0f;
+			}
+
+			const float invH = 1.0f / h;
+			const float invTick = 1.0f / tickDt;
+			vec3* last = velocity.data();
+			// x is the largest energy, y the largest force
+			vec2 peak = ThreadPool::shared().parallelReduce(0, n, SOLVER_GRAIN, vec2(0.0f), [&](size_t begin, size_t end) {
+				vec2 m(0.0f);
+				for (size_t i = begin; i < end; ++i) {
+					vec3 v = vec3(pts.position[i] - pts.previous[i]) * invH;
+					m.x = std::max(m.x, 0.5f * dot(v, v));
+					m.y = std::max(m.y, length(v - last[i]) * invTick);
+					last[i] = v;
+				}
+				return m;
+			}, [](vec2 a, vec2 b) { return glm::max(a, b); });
+
+			if (peak.x > energyThreshold || peak.y > forceThreshold) {
+				calmTime = 0.0f;
+				return false;
+			}
+			calmTime += tickDt;
+			if (calmTime < sleepTime) {
+				return false;
+			}
+			asleep = true;
+			return true;
+		}
+
+		void wake() {
+			asleep = false;
+			calmTime = 0.0f;
+			fill(velocity.begin(), velocity.end(), vec3(0.0f));
+		}
+
+	private:
+		float calmTime = 0.0f;
+		// per node, as of the last update
+		aligned_vector<vec3> velocity;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+// hands values from one writer thread to one reader thread without either ever waiting. of the
+// three slots the writer fills one, the reader reads another, and the third holds the newest
+// published value. publish() trades the writer's slot for the middle one, read() trades the
+// middle one for the reader's when something new came in since. a slot is only ever touched by
+// the side holding it, so the reader's value stays put until its next read
+template <typename T>
+class TripleBuffer {
+	public:
+		// writer only. may hold anything, the writer fills it in full before publishing
+		T& back() {
+			return slot[backSlot];
+		}
+
+		// writer only
+		void publish() {
+			backSlot = middle.exchange(backSlot | FRESH, memory_order_acq_rel) & INDEX;
+		}
+
+		// reader only. the newest published value, or the one read last time if none came since
+		const T& read() {
+			if (middle.load(memory_order_acquire) & FRESH) {
+				frontSlot = middle.exchange(frontSlot, memory_order_acq_rel) & INDEX;
+			}
+			return slot[frontSlot];
+		}
+
+	private:
+		static const unsigned int INDEX = 3;
+		static const unsigned int FRESH = 4;
+
+		T slot[3];
+		unsigned int backSlot = 0;
+		unsigned int frontSlot = 1;
+		// index of the middle slot, with FRESH set until the reader takes it
+		atomic<unsigned int> middle{ 2 };
+};
+
+// what the physics thread publishes after every tick: each cage's nodes, in cage space, where the
+// tick started and where it ended, and when it ended. the renderer draws the last tick played back
+// in real time, so frames come out smooth at one tick of latency
+struct PhysicsSnapshot {
+	vector<vector<vec3>> start;
+	vector<vector<vec3>> end;
+	// per cage, 1 when it slept through every tick since the snapshot before. its start and end are
+	// then its rest pose, the same the renderer got last time
+	vector<unsigned char> asleep;
+	// per cage, the tick its start and end were copied after. a cage that hasn't moved since keeps
+	// what it has in this slot
+	vector<unsigned long> copied;
+	// physics clock at the end of the tick, seconds
+	double time = 0.0;
+	float dt = 0.0f;
+	// ticks run so far, 0 before the first was published
+	unsigned long tick = 0;
+	// how long the tick took to compute, seconds
+	double tickSeconds = 0.0;
+
+	// cage c's nodes at time t on the physics clock into out
+	void interpolate(size_t c, double t, vector<vec3>& out) const {
+		float alpha = dt > 0.0f ? (float)std::min(1.0, std::max(0.0, (t - time) / dt)) : 1.0f;
+		const vector<vec3>& a = start[c];
+		const vector<vec3>& b = end[c];
+		out.resize(b.size());
+		for (size_t i = 0; i < b.size(); ++i) {
+			out[i] = mix(a[i], b[i], alpha);
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef SPRINGKERNEL_H
+#define SPRINGKERNEL_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SPRING_KERNEL_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPRING_KERNEL_WIDTH 4
+#else
+#define SPRING_KERNEL_WIDTH 1
+#endif
+
+using namespace std;
+using namespace glm;
+
+#include "topology.h"
+
+// springs shorter than this have no usable direction and are skipped
+const float SPRING_MIN_LENGTH2 = 1e-12f;
+
+// elastic energy 0.5 k stretch^2 and largest |stretch| / rest length of the springs a kernel went
+// over. the kernels only fill one in when they're handed it
+struct SpringEnergy {
+	double potential = 0.0;
+	float maxStrain = 0.0f;
+
+	void add(double k, double stretch, double rest) {
+		potential += 0.5 * k * stretch * stretch;
+		if (rest > 0.0) {
+			maxStrain = std::max(maxStrain, (float)(fabs(stretch) / rest));
+		}
+	}
+};
+
+// elastic + damping force of spring s acting on its v0 end (v1 gets the negative).
+// relative velocity comes from the difference of the two endpoints' verlet displacements,
+// and the direction/length share a single inverse square root.
+// positions are stored in R and the force is worked out in A, the scalar of invDt
+template <typename A, typename R>
+inline vec<3, A> springForce(const CageTopology& topo, size_t s, const vec<3, R>* position, const vec<3, R>* previous, A invDt,
+							 SpringEnergy* energy = nullptr) {
+	const unsigned int a = topo.v0[s];
+	const unsigned int b = topo.v1[s];
+
+	vec<3, A> ab = vec<3, A>(position[a]) - vec<3, A>(position[b]);
+	A len2 = dot(ab, ab);
+	if (len2 <= SPRING_MIN_LENGTH2) {
+		return vec<3, A>(0);
+	}
+
+	A invLen = A(1) / sqrt(len2);
+	vec<3, A> dir = ab * invLen;
+
+	vec<3, A> vDiff = (ab - (vec<3, A>(previous[a]) - vec<3, A>(previous[b]))) * invDt;
+
+	A stretch = len2 * invLen - A(topo.restLength[s]);
+	A magnitude = A(topo.k[s]) * stretch + A(topo.kd[s]) * dot(vDiff, dir);
+
+	if (energy) {
+		energy->add(topo.k[s], stretch, topo.restLength[s]);
+	}
+	return -magnitude * dir;
+}
+
+// scalar reference path, also handles the tail of the simd kernels
+template <typename A, typename R>
+inline void springForcesScalar(const CageTopology& topo, size_t begin, size_t end,
+							   const vec<3, R>* position, const vec<3, R>* previous, vec<3, A>* force, A invDt,
+							   SpringEnergy* energy = nullptr) {
+	for (size_t s = begin; s < end; ++s) {
+		vec<3, A> f_a = springForce(topo, s, position, previous, invDt, energy);
+		force[topo.v0[s]] += f_a;
+		force[topo.v1[s]] -= f_a;
+	}
+}
+
+// net spring force on node i pulled from the node incidence index. measured from node i, the
+// spring force on i is the v0 formula with i in the v0 slot, so the sign never has to be applied.
+// every spring is met from both ends, only its v0 end books its energy and strain
+template <typename A, typename R>
+inline vec<3, A> gatherSpringForce(const CageTopology& topo, size_t i, const vec<3, R>* position, const vec<3, R>* previous, A invDt,
+								   SpringEnergy* energy = nullptr) {
+	const vec<3, A> p_i(position[i]);
+	const vec<3, A> q_i(previous[i]);
+
+	vec<3, A> sum(0);
+	A potential(0);
+	A strain(0);
+	for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+		const unsigned int j = topo.neighbor[e];
+
+		vec<3, A> ab = p_i - vec<3, A>(position[j]);
+		A len2 = dot(ab, ab);
+		if (len2 <= SPRING_MIN_LENGTH2) {
+			continue;
+		}
+
+		A invLen = A(1) / sqrt(len2);
+		vec<3, A> dir = ab * invLen;
+		vec<3, A> vDiff = (ab - (q_i - vec<3, A>(previous[j]))) * invDt;
+
+		A stretch = len2 * invLen - A(topo.incidentRestLength[e]);
+		A magnitude = A(topo.incidentK[e]) * stretch + A(topo.incidentKd[e]) * dot(vDiff, dir);
+		sum -= magnitude * dir;
+
+		if (energy && topo.incidentSign[e] > 0.0f) {
+			potential += A(topo.incidentK[e]) * stretch * stretch;
+			strain = std::max(strain, A(fabs(stretch)) / A(topo.incidentRestLength[e]));
+		}
+	}
+
+	if (energy) {
+		energy->potential += 0.5 * potential;
+		energy->maxStrain = std::max(energy->maxStrain, float(strain));
+	}
+	return sum;
+}
+
+// pull-style evaluation over the node incidence index, each node sums the springs touching it
+// and writes only its own force. every spring is evaluated from both ends
+template <typename A, typename R>
+inline void springForcesGather(const CageTopology& topo, size_t nodeBegin, size_t nodeEnd,
+							   const vec<3, R>* position, const vec<3, R>* previous, vec<3, A>* force, A invDt) {
+	for (size_t i = nodeBegin; i < nodeEnd; ++i) {
+		force[i] += gatherSpringForce(topo, i, position, previous, invDt);
+	}
+}
+
+#if SPRING_KERNEL_WIDTH == 8
+
+inline void springForcesSimd(const CageTopology& topo, size_t begin, size_t end,
+							 const vec3* position, const vec3* previous, vec3* force, float invDt,
+							 SpringEnergy* energy = nullptr) {
+	const float* p = &position[0].x;
+	const float* q = &previous[0].x;
+
+	const __m256 vInvDt = _mm256_set1_ps(invDt);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 threeHalves = _mm256_set1_ps(1.5f);
+	const __m256 minLen2 = _mm256_set1_ps(SPRING_MIN_LENGTH2);
+	const __m256i three = _mm256_set1_epi32(3);
+
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	alignas(32) float fx[8], fy[8], fz[8];
+	// per lane energy and strain, only touched when energy is asked for. strain uses the approximate
+	// reciprocal of the rest length, good to about 4 digits
+	__m256 potential = _mm256_setzero_ps();
+	__m256 strain = _mm256_setzero_ps();
+
+	size_t s = begin;
+	for (; s + 8 <= end; s += 8) {
+		// gather both endpoints
+		__m256i ia = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)&topo.v0[s]), three);
+		__m256i ib = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)&topo.v1[s]), three);
+
+		__m256 abx = _mm256_sub_ps(_mm256_i32gather_ps(p, ia, 4), _mm256_i32gather_ps(p, ib, 4));
+		__m256 aby = _mm256_sub_ps(_mm256_i32gather_ps(p + 1, ia, 4), _mm256_i32gather_ps(p + 1, ib, 4));
+		__m256 abz = _mm256_sub_ps(_mm256_i32gather_ps(p + 2, ia, 4), _mm256_i32gather_ps(p + 2, ib, 4));
+
+		__m256 pabx = _mm256_sub_ps(_mm256_i32gather_ps(q, ia, 4), _mm256_i32gather_ps(q, ib, 4));
+		__m256 paby = _mm256_sub_ps(_mm256_i32gather_ps(q + 1, ia, 4), _mm256_i32gather_ps(q + 1, ib, 4));
+		__m256 pabz = _mm256_sub_ps(_mm256_i32gather_ps(q + 2, ia, 4), _mm256_i32gather_ps(q + 2, ib, 4));
+
+		// 1 / |ab| with one newton step on top of rsqrt
+		__m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abx, abx), _mm256_mul_ps(aby, aby)), _mm256_mul_ps(abz, abz));
+		__m256 valid = _mm256_cmp_ps(len2, minLen2, _CMP_GT_OQ);
+		__m256 r = _mm256_rsqrt_ps(len2);
+		r = _mm256_mul_ps(r, _mm256_sub_ps(threeHalves, _mm256_mul_ps(_mm256_mul_ps(half, len2), _mm256_mul_ps(r, r))));
+		r = _mm256_and_ps(r, valid);
+
+		__m256 dx = _mm256_mul_ps(abx, r);
+		__m256 dy = _mm256_mul_ps(aby, r);
+		__m256 dz = _mm256_mul_ps(abz, r);
+
+		// relative velocity along the spring
+		__m256 vx = _mm256_mul_ps(_mm256_sub_ps(abx, pabx), vInvDt);
+		__m256 vy = _mm256_mul_ps(_mm256_sub_ps(aby, paby), vInvDt);
+		__m256 vz = _mm256_mul_ps(_mm256_sub_ps(abz, pabz), vInvDt);
+		__m256 vAlong = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, dx), _mm256_mul_ps(vy, dy)), _mm256_mul_ps(vz, dz));
+
+		__m256 rest = _mm256_loadu_ps(&topo.restLength[s]);
+		__m256 k = _mm256_loadu_ps(&topo.k[s]);
+		__m256 stretch = _mm256_sub_ps(_mm256_mul_ps(len2, r), rest);
+		__m256 magnitude = _mm256_add_ps(_mm256_mul_ps(k, stretch),
+										 _mm256_mul_ps(_mm256_loadu_ps(&topo.kd[s]), vAlong));
+		magnitude = _mm256_and_ps(magnitude, valid);
+
+		if (energy) {
+			potential = _mm256_add_ps(potential, _mm256_and_ps(_mm256_mul_ps(_mm256_mul_ps(half, k), _mm256_mul_ps(stretch, stretch)), valid));
+			strain = _mm256_max_ps(strain, _mm256_and_ps(_mm256_mul_ps(_mm256_andnot_ps(signBit, stretch), _mm256_rcp_ps(rest)), valid));
+		}
+
+		_mm256_store_ps(fx, _mm256_mul_ps(magnitude, dx));
+		_mm256_store_ps(fy, _mm256_mul_ps(magnitude, dy));
+		_mm256_store_ps(fz, _mm256_mul_ps(magnitude, dz));
+
+		// scatter, lanes in order so shared endpoints accumulate exactly like the scalar loop
+		for (int l = 0; l < 8; ++l) {
+			vec3 f_a(-fx[l], -fy[l], -fz[l]);
+			force[topo.v0[s + l]] += f_a;
+			force[topo.v1[s + l]] -= f_a;
+		}
+	}
+
+	if (energy) {
+		alignas(32) float e[8], m[8];
+		_mm256_store_ps(e, potential);
+		_mm256_store_ps(m, strain);
+		for (int l = 0; l < 8; ++l) {
+			energy->potential += e[l];
+			energy->maxStrain = std::max(energy->maxStrain, m[l]);
+		}
+	}
+
+	springForcesScalar(topo, s, end, position, previous, force, invDt, energy);
+}
+
+#elif SPRING_KERNEL_WIDTH == 4
+
+inline void springForcesSimd(const CageTopology& topo, size_t begin, size_t end,
+							 const vec3* position, const vec3* previous, vec3* force, float invDt,
+							 SpringEnergy* energy = nullptr) {
+	const __m128 vInvDt = _mm_set1_ps(invDt);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 threeHalves = _mm_set1_ps(1.5f);
+	const __m128 minLen2 = _mm_set1_ps(SPRING_MIN_LENGTH2);
+
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	alignas(16) float fx[4], fy[4], fz[4];
+	// per lane energy and strain, only touched when energy is asked for. strain uses the approximate
+	// reciprocal of the rest length, good to about 4 digits
+	__m128 potential = _mm_setzero_ps();
+	__m128 strain = _mm_setzero_ps();
+
+	size_t s = begin;
+	for (; s + 4 <= end; s += 4) {
+		// no hardware gather before avx2, build the lanes by hand
+		const vec3 ab0 = position[topo.v0[s]] - position[topo.v1[s]];
+		const vec3 ab1 = position[topo.v0[s + 1]] - position[topo.v1[s + 1]];
+		const vec3 ab2 = position[topo.v0[s + 2]] - position[topo.v1[s + 2]];
+		const vec3 ab3 = position[topo.v0[s + 3]] - position[topo.v1[s + 3]];
+		const vec3 pab0 = previous[topo.v0[s]] - previous[topo.v1[s]];
+		const vec3 pab1 = previous[topo.v0[s + 1]] - previous[topo.v1[s + 1]];
+		const vec3 pab2 = previous[topo.v0[s + 2]] - previous[topo.v1[s + 2]];
+		const vec3 pab3 = previous[topo.v0[s + 3]] - previous[topo.v1[s + 3]];
+
+		__m128 abx = _mm_setr_ps(ab0.x, ab1.x, ab2.x, ab3.x);
+		__m128 aby = _mm_setr_ps(ab0.y, ab1.y, ab2.y, ab3.y);
+		__m128 abz = _mm_setr_ps(ab0.z, ab1.z, ab2.z, ab3.z);
+
+		__m128 pabx = _mm_setr_ps(pab0.x, pab1.x, pab2.x, pab3.x);
+		__m128 paby = _mm_setr_ps(pab0.y, pab1.y, pab2.y, pab3.y);
+		__m128 pabz = _mm_setr_ps(pab0.z, pab1.z, pab2.z, pab3.z);
+
+		// 1 / |ab| with one newton step on top of rsqrt
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, abx), _mm_mul_ps(aby, aby)), _mm_mul_ps(abz, abz));
+		__m128 valid = _mm_cmpgt_ps(len2, minLen2);
+		__m128 r = _mm_rsqrt_ps(len2);
+		r = _mm_mul_ps(r, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, len2), _mm_mul_ps(r, r))));
+		r = _mm_and_ps(r, valid);
+
+		__m128 dx = _mm_mul_ps(abx, r);
+		__m128 dy = _mm_mul_ps(aby, r);
+		__m128 dz = _mm_mul_ps(abz, r);
+
+		// relative velocity along the spring
+		__m128 vx = _mm_mul_ps(_mm_sub_ps(abx, pabx), vInvDt);
+		__m128 vy = _mm_mul_ps(_mm_sub_ps(aby, paby), vInvDt);
+		__m128 vz = _mm_mul_ps(_mm_sub_ps(abz, pabz), vInvDt);
+		__m128 vAlong = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+
+		__m128 rest = _mm_loadu_ps(&topo.restLength[s]);
+		__m128 k = _mm_loadu_ps(&topo.k[s]);
+		__m128 stretch = _mm_sub_ps(_mm_mul_ps(len2, r), rest);
+		__m128 magnitude = _mm_add_ps(_mm_mul_ps(k, stretch),
+									  _mm_mul_ps(_mm_loadu_ps(&topo.kd[s]), vAlong));
+		magnitude = _mm_and_ps(magnitude, valid);
+
+		if (energy) {
+			potential = _mm_add_ps(potential, _mm_and_ps(_mm_mul_ps(_mm_mul_ps(half, k), _mm_mul_ps(stretch, stretch)), valid));
+			strain = _mm_max_ps(strain, _mm_and_ps(_mm_mul_ps(_mm_andnot_ps(signBit, stretch), _mm_rcp_ps(rest)), valid));
+		}
+
+		_mm_store_ps(fx, _mm_mul_ps(magnitude, dx));
+		_mm_store_ps(fy, _mm_mul_ps(magnitude, dy));
+		_mm_store_ps(fz, _mm_mul_ps(magnitude, dz));
+
+		// scatter, lanes in order so shared endpoints accumulate exactly like the scalar loop
+		for (int l = 0; l < 4; ++l) {
+			vec3 f_a(-fx[l], -fy[l], -fz[l]);
+			force[topo.v0[s + l]] += f_a;
+			force[topo.v1[s + l]] -= f_a;
+		}
+	}
+
+	if (energy) {
+		alignas(16) float e[4], m[4];
+		_mm_store_ps(e, potential);
+		_mm_store_ps(m, strain);
+		for (int l = 0; l < 4; ++l) {
+			energy->potential += e[l];
+			energy->maxStrain = std::max(energy->maxStrain, m[l]);
+		}
+	}
+
+	springForcesScalar(topo, s, end, position, previous, force, invDt, energy);
+}
+
+#else
+
+inline void springForcesSimd(const CageTopology& topo, size_t begin, size_t end,
+							 const vec3* position, const vec3* previous, vec3* force, float invDt,
+							 SpringEnergy* energy = nullptr) {
+	springForcesScalar(topo, begin, end, position, previous, force, invDt, energy);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef STATEHASH_H
+#define STATEHASH_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "threadpool.h"
+
+const uint64_t HASH_OFFSET = 14695981039346656037ull;
+const uint64_t HASH_PRIME = 1099511628211ull;
+
+// rolling fnv-1a hash of a cage's node positions, folded in after every step. two runs that agree
+// on every step's hash took bit identical steps, the first step where they differ is where they split.
+// the nodes are hashed in fixed SOLVER_GRAIN chunks combined in index order, so the value doesn't
+// depend on the thread count either
+class StateHash {
+	public:
+		uint64_t value = HASH_OFFSET;
+		unsigned long steps = 0;
+
+		// when set every step writes "<step> <hash>" to it, logs of two runs can be diffed line by line
+		ostream* log = nullptr;
+
+		// Store is a BasicNodeStore of any precision, the raw bits of the positions are hashed
+		template <typename Store>
+		uint64_t update(const Store& pts) {
+			uint64_t h = ThreadPool::shared().parallelReduce(0, pts.size(), SOLVER_GRAIN, uint64_t(0),
+				[&](size_t begin, size_t end) {
+					uint64_t c = HASH_OFFSET;
+					for (size_t i = begin; i < end; ++i) {
+						c = mix(c, pts.position[i].x);
+						c = mix(c, pts.position[i].y);
+						c = mix(c, pts.position[i].z);
+					}
+					return c;
+				}, [](uint64_t a, uint64_t b) { return (a ^ b) * HASH_PRIME; });
+
+			value = (value ^ h) * HASH_PRIME;
+			++steps;
+			if (log) {
+				*log << steps << " " << hex << value << dec << "\n";
+			}
+			return value;
+		}
+
+		void reset() {
+			value = HASH_OFFSET;
+			steps = 0;
+		}
+
+	private:
+		template <typename T>
+		static uint64_t mix(uint64_t h, T x) {
+			uint64_t bits = 0;
+			memcpy(&bits, &x, sizeof(T));
+			return (h ^ bits) * HASH_PRIME;
+		}
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <ostream>
+#include <cstdio>
+
+using namespace std;
+
+#include "threadpool.h"
+
+// named tasks and the order they have to run in, run on the thread pool. a task is spawned as soon
+// as everything before it has finished, so tasks with no path between them run side by side and
+// whatever they parallelFor over is shared out between the threads that are free. every run
+// records when, for how long and on which thread each task ran, dumpTimings prints it
+class TaskGraph {
+	public:
+		typedef size_t TaskId;
+
+		// fn runs after every task in after
+		TaskId add(const string& name, function<void()> fn, const vector<TaskId>& after = vector<TaskId>()) {
+			TaskId id = task.size();
+			task.emplace_back();
+			task[id].name = name;
+			task[id].fn = move(fn);
+			for (TaskId before : after) {
+				precede(before, id);
+			}
+			return id;
+		}
+
+		void precede(TaskId before, TaskId after) {
+			task[before].next.push_back(after);
+			++task[after].numBefore;
+		}
+
+		size_t size() const {
+			return task.size();
+		}
+
+		void clear() {
+			task.clear();
+		}
+
+		// blocks until every task has run
+		void run(ThreadPool& pool = ThreadPool::shared()) {
+			waiting.reset(new atomic<size_t>[task.size()]);
+			for (size_t i = 0; i < task.size(); ++i) {
+				waiting[i].store(task[i].numBefore);
+			}
+
+			ThreadPool::TaskGroup group;
+			runStart = clock::now();
+			for (TaskId i = 0; i < task.size(); ++i) {
+				if (task[i].numBefore == 0) {
+					launch(pool, group, i);
+				}
+			}
+			pool.wait(group);
+			runSeconds = seconds(runStart, clock::now());
+		}
+
+		// the last run, one line per task in the order they started: the thread (0 is the one that
+		// called run), start and duration in ms. the last line compares the summed task time with
+		// the run's wall time
+		void dumpTimings(ostream& out) const {
+			vector<TaskId> order(task.size());
+			for (TaskId i = 0; i < task.size(); ++i) {
+				order[i] = i;
+			}
+			stable_sort(order.begin(), order.end(), [&](TaskId a, TaskId b) {
+				return task[a].start < task[b].start;
+			});
+
+			char line[256];
+			double busy = 0.0;
+			snprintf(line, sizeof(line), "%-32s %6s %10s %10s\n", "task", "thread", "start ms", "ms");
+			out << line;
+			for (TaskId i : order) {
+				const Task& t = task[i];
+				snprintf(line, sizeof(line), "%-32s %6u %10.3f %10.3f\n", t.name.c_str(), t.thread, t.start * 1e3, t.seconds * 1e3);
+				out << line;
+				busy += t.seconds;
+			}
+			snprintf(line, sizeof(line), "%zu tasks, %.3f ms of work in %.3f ms, %.2f running at once on average\n",
+				task.size(), busy * 1e3, runSeconds * 1e3, runSeconds > 0.0 ? busy / runSeconds : 0.0);
+			out << line;
+		}
+
+	private:
+		typedef chrono::steady_clock clock;
+
+		struct Task {
+			string name;
+			function<void()> fn;
+			vector<TaskId> next;
+			size_t numBefore = 0;
+
+			// from the last run, start is relative to the run's
+			unsigned int thread = 0;
+			double start = 0.0;
+			double seconds = 0.0;
+		};
+
+		vector<Task> task;
+		// tasks still to finish before each task may start, counted down during a run
+		unique_ptr<atomic<size_t>[]> waiting;
+		clock::time_point runStart;
+		double runSeconds = 0.0;
+
+		static double seconds(clock::time_point from, clock::time_point to) {
+			return chrono::duration<double>(to - from).count();
+		}
+
+		void launch(ThreadPool& pool, ThreadPool::TaskGroup& group, TaskId id) {
+			pool.spawn(group, [this, &pool, &group, id] {
+				Task& t = task[id];
+				t.thread = pool.currentThread();
+				clock::time_point begin = clock::now();
+				t.fn();
+				clock::time_point end = clock::now();
+				t.start = seconds(runStart, begin);
+				t.seconds = seconds(begin, end);
+
+				for (TaskId n : t.next) {
+					if (waiting[n].fetch_sub(1) == 1) {
+						launch(pool, group, n);
+					}
+				}
+			});
+		}
+};
+
+#endif
@@ -0,0 +1,295 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+// fixed set of worker threads sharing tasks by work stealing. every worker keeps a queue of the
+// tasks it spawned and runs the newest first, a worker that runs dry takes the oldest task off
+// someone else's queue. threads outside the pool share one more queue. whoever waits for tasks
+// runs queued ones meanwhile, so tasks may spawn and wait for tasks of their own: a parallelFor
+// inside a task splits its range between whichever threads are free at the time
+class ThreadPool {
+	public:
+		// tasks spawned into one group, wait() returns once all of them are done
+		class TaskGroup {
+			public:
+				TaskGroup() : pending(0) {}
+
+			private:
+				friend class ThreadPool;
+				atomic<size_t> pending;
+		};
+
+		ThreadPool(unsigned int numThreads = thread::hardware_concurrency()) {
+			start(numThreads);
+		}
+
+		~ThreadPool() {
+			stop();
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// process wide pool used by the cages
+		static ThreadPool& shared() {
+			static ThreadPool pool;
+			return pool;
+		}
+
+		// number of threads taking part in a parallelFor, including the caller
+		unsigned int size() const {
+			return workers.size() + 1;
+		}
+
+		// 1 + the worker's index on a worker of this pool, 0 on any other thread
+		unsigned int currentThread() const {
+			const Slot& slot = currentSlot();
+			return slot.pool == this ? (unsigned int)slot.queue : 0;
+		}
+
+		// only while no tasks are running
+		void resize(unsigned int numThreads) {
+			stop();
+			start(numThreads);
+		}
+
+		// queues fn() to run on some thread of the pool
+		template <typename F>
+		void spawn(TaskGroup& group, F&& fn) {
+			group.pending.fetch_add(1);
+			Queue& q = *queues[currentThread()];
+			// counted before it's queued, so queued never drops below the tasks actually there
+			queued.fetch_add(1);
+			{
+				lock_guard<mutex> lock(q.m);
+				q.tasks.push_back(Task{ function<void()>(forward<F>(fn)), &group });
+			}
+			if (sleeping.load() > 0) {
+				lock_guard<mutex> lock(m);
+				wake.notify_one();
+			}
+		}
+
+		// runs queued tasks, the group's or anyone's, until every task of the group has finished.
+		// with nothing to take it yields a few times for tasks about to finish, then sleeps until
+		// one of the group's last task finishes or more tasks are queued
+		void wait(TaskGroup& group) {
+			int idle = 0;
+			while (group.pending.load(memory_order_acquire) > 0) {
+				Task task;
+				if (take(task)) {
+					run(task);
+					idle = 0;
+					continue;
+				}
+				if (++idle < WAIT_SPINS) {
+					this_thread::yield();
+					continue;
+				}
+
+				unique_lock<mutex> lock(m);
+				sleeping.fetch_add(1);
+				waiting.fetch_add(1);
+				wake.wait(lock, [&] { return group.pending.load() == 0 || queued.load() > 0; });
+				waiting.fetch_sub(1);
+				sleeping.fetch_sub(1);
+				idle = 0;
+			}
+		}
+
+		// calls fn(chunkBegin, chunkEnd) over [begin, end) in chunks of at least grain. the caller
+		// does the first chunk and helps with the rest
+		template <typename F>
+		void parallelFor(size_t begin, size_t end, size_t grain, F&& fn) {
+			if (end <= begin) {
+				return;
+			}
+
+			size_t n = end - begin;
+			if (workers.empty() || n <= grain) {
+				fn(begin, end);
+				return;
+			}
+
+			struct Range {
+				F& fn;
+				size_t begin;
+				size_t end;
+				size_t chunk;
+			} range = { fn, begin, end, std::max(grain, (n + size() * 4 - 1) / (size() * 4)) };
+			size_t numChunks = (n + range.chunk - 1) / range.chunk;
+
+			TaskGroup group;
+			for (size_t c = 1; c < numChunks; ++c) {
+				// a pointer and an index, small enough for std::function to keep without allocating
+				spawn(group, [r = &range, c] {
+					size_t b = r->begin + c * r->chunk;
+					r->fn(b, std::min(r->end, b + r->chunk));
+				});
+			}
+			fn(begin, std::min(end, begin + range.chunk));
+			wait(group);
+		}
+
+		// sums fn(chunkBegin, chunkEnd) over [begin, end). chunks are always exactly grain wide and
+		// their partial sums are added in index order, so the result does not depend on thread count
+		template <typename T, typename F>
+		T parallelReduce(size_t begin, size_t end, size_t grain, T zero, F&& fn) {
+			return parallelReduce(begin, end, grain, zero, fn, [](const T& a, const T& b) { return a + b; });
+		}
+
+		// the same with the partials folded by combine(a, b) instead of +
+		template <typename T, typename F, typename C>
+		T parallelReduce(size_t begin, size_t end, size_t grain, T zero, F&& fn, C&& combine) {
+			if (end <= begin) {
+				return zero;
+			}
+
+			size_t chunks = (end - begin + grain - 1) / grain;
+			vector<T> partial(chunks, zero);
+			parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+				for (size_t c = first; c < last; ++c) {
+					size_t b = begin + c * grain;
+					partial[c] = fn(b, std::min(end, b + grain));
+				}
+			});
+
+			T result = zero;
+			for (auto& p : partial) {
+				result = combine(result, p);
+			}
+			return result;
+		}
+
+	private:
+		struct Task {
+			function<void()> fn;
+			TaskGroup* group = nullptr;
+		};
+
+		struct Queue {
+			mutex m;
+			deque<Task> tasks;
+		};
+
+		// which pool and queue the running thread belongs to
+		struct Slot {
+			const ThreadPool* pool = nullptr;
+			size_t queue = 0;
+		};
+
+		// yields in wait before it sleeps
+		static const int WAIT_SPINS = 64;
+
+		vector<thread> workers;
+		// queues[0] is for threads outside the pool, queues[i] for worker i - 1
+		vector<unique_ptr<Queue>> queues;
+		atomic<size_t> queued{ 0 };
+		atomic<size_t> sleeping{ 0 };
+		// the sleepers that are in wait, woken when a group finishes
+		atomic<size_t> waiting{ 0 };
+		mutex m;
+		condition_variable wake;
+		bool stopping = false;
+
+		static Slot& currentSlot() {
+			static thread_local Slot slot;
+			return slot;
+		}
+
+		void start(unsigned int numThreads) {
+			stopping = false;
+			numThreads = std::max(numThreads, 1u);
+			queues.clear();
+			for (unsigned int i = 0; i < numThreads; ++i) {
+				queues.emplace_back(new Queue());
+			}
+			for (unsigned int i = 1; i < numThreads; ++i) {
+				workers.emplace_back([this, i] { workerLoop(i); });
+			}
+		}
+
+		void stop() {
+			{
+				lock_guard<mutex> lock(m);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (auto& w : workers) {
+				w.join();
+			}
+			workers.clear();
+		}
+
+		// the newest task of the thread's own queue, else the oldest of the first other queue
+		// that has one
+		bool take(Task& task) {
+			if (queued.load() == 0) {
+				return false;
+			}
+			size_t own = currentThread();
+			{
+				Queue& q = *queues[own];
+				lock_guard<mutex> lock(q.m);
+				if (!q.tasks.empty()) {
+					task = move(q.tasks.back());
+					q.tasks.pop_back();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			for (size_t i = 1; i < queues.size(); ++i) {
+				Queue& q = *queues[(own + i) % queues.size()];
+				lock_guard<mutex> lock(q.m);
+				if (!q.tasks.empty()) {
+					task = move(q.tasks.front());
+					q.tasks.pop_front();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// the group may be gone as soon as its count reaches 0, only the pool is touched after that
+		void run(Task& task) {
+			task.fn();
+			if (task.group->pending.fetch_sub(1) == 1 && waiting.load() > 0) {
+				lock_guard<mutex> lock(m);
+				wake.notify_all();
+			}
+		}
+
+		void workerLoop(size_t queue) {
+			currentSlot().pool = this;
+			currentSlot().queue = queue;
+			while (true) {
+				Task task;
+				if (take(task)) {
+					run(task);
+					continue;
+				}
+
+				unique_lock<mutex> lock(m);
+				sleeping.fetch_add(1);
+				wake.wait(lock, [&] { return stopping || queued.load() > 0; });
+				sleeping.fetch_sub(1);
+				if (stopping) {
+					return;
+				}
+			}
+		}
+};
+
+#endif
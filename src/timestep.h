@@ -0,0 +1,179 @@
+#ifndef TIMESTEP_H
+#define TIMESTEP_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "springkernel.h"
+#include "chebyshev.h"
+
+// fixed timestep scheduler. frame time goes into an accumulator and comes out as whole ticks of dt,
+// each tick runs substeps physics steps of dt / substeps. what's left over is the fraction of a tick
+// rendering should blend the last two physics states by. a frame never runs more than maxTicks,
+// time beyond that is dropped so a slow frame can't snowball into slower and slower ones
+class FixedStepper {
+	public:
+		float dt;
+		int substeps;
+		int maxTicks;
+
+		// whole ticks dropped by the cap so far
+		long droppedTicks = 0;
+
+		FixedStepper(float dt = 1.0f / 60, int substeps = 1, int maxTicks = 5) {
+			this->dt = dt;
+			this->substeps = substeps;
+			this->maxTicks = maxTicks;
+		}
+
+		// adds a frame's time, returns how many ticks to run now
+		int advance(float frameTime) {
+			accumulator += frameTime;
+			int ticks = (int)(accumulator / dt);
+			if (ticks > maxTicks) {
+				droppedTicks += ticks - maxTicks;
+				ticks = maxTicks;
+				accumulator = fmod(accumulator, dt) + ticks * dt;
+			}
+			accumulator -= ticks * dt;
+			return ticks;
+		}
+
+		float substepDt() const {
+			return dt / substeps;
+		}
+
+		// how far the time after the last tick is into the next one, 0 to 1
+		float alpha() const {
+			return accumulator / dt;
+		}
+
+	private:
+		float accumulator = 0.0f;
+};
+
+// picks how many substeps an explicit (verlet) cage needs for a tick. the stability limit is
+// 2 / (omega + c) with omega^2 the largest eigenvalue of M^-1 K and c that of M^-1 D. both are
+// estimated by power iteration once per topology and masses, with the springs linearized around
+// the shape at that time. on top of that the step shrinks with the current max
+// strain (accuracy while squashed) and with node speed, so no node crosses more than
+// maxDisplacement of the shortest spring in one substep
+class TimestepController {
+	public:
+		// fraction of the stability limit actually used
+		float safety = 0.8f;
+		// most a node may move in one substep, in shortest rest lengths
+		float maxDisplacement = 0.25f;
+		// strain at which the step is halved
+		float strainScale = 0.5f;
+		int maxSubsteps = 64;
+
+		// from the last call
+		float stableStep = 0.0f;
+		float maxStrain = 0.0f;
+		float maxSpeed = 0.0f;
+
+		// lastStep is the step the current velocities (position - previous) were taken over.
+		// Store is a BasicNodeStore of any precision, the estimate itself is done in float
+		template <typename Store>
+		int substeps(const Store& pts, const CageTopology& topo, float dt, float lastStep) {
+			if (&topo != builtFor || topo.revision != builtRevision
+				|| !equal(pts.mass.begin(), pts.mass.end(), builtMass.begin(), builtMass.end())) {
+				analyze(pts, topo);
+			}
+
+			ThreadPool& pool = ThreadPool::shared();
+			auto larger = [](float a, float b) { return std::max(a, b); };
+			maxStrain = pool.parallelReduce(0, topo.numSprings(), SOLVER_GRAIN, 0.0f, [&](size_t begin, size_t end) {
+				float strain = 0.0f;
+				for (size_t s = begin; s < end; ++s) {
+					float len = distance(vec3(pts.position[topo.v0[s]]), vec3(pts.position[topo.v1[s]]));
+					strain = std::max(strain, fabs(len - topo.restLength[s]) / topo.restLength[s]);
+				}
+				return strain;
+			}, larger);
+			float maxMove = pool.parallelReduce(0, pts.size(), SOLVER_GRAIN, 0.0f, [&](size_t begin, size_t end) {
+				float move = 0.0f;
+				for (size_t i = begin; i < end; ++i) {
+					move = std::max(move, distance(vec3(pts.position[i]), vec3(pts.previous[i])));
+				}
+				return move;
+			}, larger);
+			maxSpeed = lastStep > 0.0f ? maxMove / lastStep : 0.0f;
+
+			float h = stableStep / (1.0f + maxStrain / strainScale);
+			if (maxSpeed > 0.0f && minRestLength > 0.0f) {
+				h = std::min(h, maxDisplacement * minRestLength / maxSpeed);
+			}
+			if (!(h > 0.0f)) {
+				return maxSubsteps;
+			}
+			return std::min(maxSubsteps, std::max(1, (int)ceil(dt / h)));
+		}
+
+	private:
+		float minRestLength = 0.0f;
+
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+		vector<double> builtMass;
+
+		template <typename Store>
+		void analyze(const Store& pts, const CageTopology& topo) {
+			const size_t n = pts.size();
+
+			// v <- M^-1 K v with K the spring stiffness (or damping) linearized at the current shape,
+			// sum of w d d^T over the springs. v holds x, y, z per node
+			auto linearized = [&](const float* weight) {
+				return [&pts, &topo, weight, n](const vector<float>& in, vector<float>& out) {
+					for (size_t i = 0; i < n; ++i) {
+						vec3 xi(pts.position[i]);
+						vec3 vi(in[3 * i], in[3 * i + 1], in[3 * i + 2]);
+						vec3 sum(0.0f);
+						for (unsigned int e = topo.nodeOffsets[i]; e < topo.nodeOffsets[i + 1]; ++e) {
+							unsigned int j = topo.neighbor[e];
+							vec3 x = xi - vec3(pts.position[j]);
+							float len2 = dot(x, x);
+							if (len2 <= SPRING_MIN_LENGTH2) {
+								continue;
+							}
+							vec3 d = x / sqrt(len2);
+							vec3 vj(in[3 * j], in[3 * j + 1], in[3 * j + 2]);
+							sum += weight[e] * dot(d, vi - vj) * d;
+						}
+						sum *= (float)pts.invMass[i];
+						out[3 * i] = sum.x;
+						out[3 * i + 1] = sum.y;
+						out[3 * i + 2] = sum.z;
+					}
+				};
+			};
+			float stiffness = estimateSpectralRadius(3 * n, linearized(topo.incidentK.data()));
+			float damping = estimateSpectralRadius(3 * n, linearized(topo.incidentKd.data()));
+
+			float limit = sqrt(stiffness) + damping;
+			stableStep = limit > 0.0f ? safety * 2.0f / limit : 0.0f;
+
+			minRestLength = 0.0f;
+			for (size_t s = 0; s < topo.numSprings(); ++s) {
+				if (minRestLength == 0.0f || topo.restLength[s] < minRestLength) {
+					minRestLength = topo.restLength[s];
+				}
+			}
+
+			builtFor = &topo;
+			builtRevision = topo.revision;
+			builtMass.assign(pts.mass.begin(), pts.mass.end());
+		}
+};
+
+#endif
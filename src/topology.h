@@ -0,0 +1,267 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "threadpool.h"
+
+enum SpringType {
+	EDGE,
+	SHEAR,
+	SHEAR_BODY,
+	BEND,
+	SURFACE
+};
+
+struct Spring {
+    // the indices of the two point masses attached
+    unsigned int v0;
+    unsigned int v1;
+	float restLength;
+
+    float k;
+	float kd;
+
+	Spring(unsigned int v0, unsigned int v1, float k, float kd, float rl) {
+		this->v0 = v0;
+		this->v1 = v1;
+		this->k = k;
+		this->kd = kd;
+
+		// Set to some constant, its a cube so all would the same distance, how far are positions from one another typically
+		this->restLength = rl;
+	}
+};
+
+// springs per batch block, see CageTopology
+const size_t SPRING_BLOCK_SIZE = 1024;
+
+// everything derived from a cage's spring list that only changes when the topology does.
+// springs are repacked into aligned arrays so the force kernels can stream them. the list is cut
+// into blocks of SPRING_BLOCK_SIZE consecutive springs and the blocks are colored: no two blocks
+// of the same color share a node, so a color's blocks can be processed in parallel without two
+// threads ever writing the same force. coloring whole blocks instead of single springs keeps each
+// batch inside one region of the node arrays
+struct CageTopology {
+	aligned_vector<unsigned int> v0;
+	aligned_vector<unsigned int> v1;
+	aligned_vector<float> restLength;
+	aligned_vector<float> k;
+	aligned_vector<float> kd;
+
+	// springs of block b are [blockOffsets[b], blockOffsets[b + 1]),
+	// blocks of color c are [colorOffsets[c], colorOffsets[c + 1])
+	vector<size_t> blockOffsets;
+	vector<size_t> colorOffsets;
+
+	// node -> incident springs (CSR). node i's springs are incident[nodeOffsets[i] .. nodeOffsets[i + 1]),
+	// incidentSign is +1 where i is the spring's v0 and -1 where it is v1. the other endpoint and the
+	// spring constants are copied alongside so a gather streams through memory instead of chasing ids
+	aligned_vector<unsigned int> nodeOffsets;
+	aligned_vector<unsigned int> incident;
+	aligned_vector<float> incidentSign;
+	aligned_vector<unsigned int> neighbor;
+	aligned_vector<float> incidentRestLength;
+	aligned_vector<float> incidentK;
+	aligned_vector<float> incidentKd;
+
+	// renewed by every build(), solvers that derive their own data from the topology compare it
+	// against the revision they built from. revisions are unique across all topologies, so a new
+	// one that lands where a freed one was can't pass for it
+	unsigned int revision = 0;
+
+	size_t numSprings() const {
+		return v0.size();
+	}
+
+	size_t numColors() const {
+		return colorOffsets.empty() ? 0 : colorOffsets.size() - 1;
+	}
+
+	size_t numBlocks() const {
+		return blockOffsets.empty() ? 0 : blockOffsets.size() - 1;
+	}
+
+	void build(const vector<Spring>& springs, size_t numNodes) {
+		size_t n = springs.size();
+		size_t blocks = (n + SPRING_BLOCK_SIZE - 1) / SPRING_BLOCK_SIZE;
+		vector<unsigned int> color = colorBlocks(springs, numNodes);
+
+		// counting sort blocks by color, keeping spring order inside a color
+		colorOffsets.assign(1, 0);
+		for (unsigned int c : color) {
+			if (c + 2 > colorOffsets.size()) {
+				colorOffsets.resize(c + 2, 0);
+			}
+			++colorOffsets[c + 1];
+		}
+		for (size_t c = 1; c < colorOffsets.size(); ++c) {
+			colorOffsets[c] += colorOffsets[c - 1];
+		}
+
+		vector<size_t> blockOrder(blocks);
+		vector<size_t> cursor(colorOffsets.begin(), colorOffsets.end() - 1);
+		for (size_t b = 0; b < blocks; ++b) {
+			blockOrder[cursor[color[b]]++] = b;
+		}
+
+		v0.resize(n);
+		v1.resize(n);
+		restLength.resize(n);
+		k.resize(n);
+		kd.resize(n);
+		blockOffsets.assign(1, 0);
+
+		size_t dst = 0;
+		for (size_t b : blockOrder) {
+			size_t end = std::min(n, (b + 1) * SPRING_BLOCK_SIZE);
+			for (size_t i = b * SPRING_BLOCK_SIZE; i < end; ++i, ++dst) {
+				v0[dst] = springs[i].v0;
+				v1[dst] = springs[i].v1;
+				restLength[dst] = springs[i].restLength;
+				k[dst] = springs[i].k;
+				kd[dst] = springs[i].kd;
+			}
+			blockOffsets.push_back(dst);
+		}
+
+		buildIncidence(numNodes);
+		revision = nextRevision();
+	}
+
+	private:
+		static unsigned int nextRevision() {
+			static atomic<unsigned int> counter(0);
+			return ++counter;
+		}
+
+		void buildIncidence(size_t numNodes) {
+			nodeOffsets.assign(numNodes + 1, 0);
+			for (size_t s = 0; s < numSprings(); ++s) {
+				++nodeOffsets[v0[s] + 1];
+				++nodeOffsets[v1[s] + 1];
+			}
+			for (size_t i = 1; i <= numNodes; ++i) {
+				nodeOffsets[i] += nodeOffsets[i - 1];
+			}
+
+			size_t n = 2 * numSprings();
+			incident.resize(n);
+			incidentSign.resize(n);
+			neighbor.resize(n);
+			incidentRestLength.resize(n);
+			incidentK.resize(n);
+			incidentKd.resize(n);
+
+			vector<unsigned int> cursor(nodeOffsets.begin(), nodeOffsets.end() - 1);
+			for (size_t s = 0; s < numSprings(); ++s) {
+				unsigned int ends[2] = { cursor[v0[s]]++, cursor[v1[s]]++ };
+				for (int e = 0; e < 2; ++e) {
+					unsigned int slot = ends[e];
+					incident[slot] = (unsigned int)s;
+					incidentSign[slot] = e == 0 ? 1.0f : -1.0f;
+					neighbor[slot] = e == 0 ? v1[s] : v0[s];
+					incidentRestLength[slot] = restLength[s];
+					incidentK[slot] = k[s];
+					incidentKd[slot] = kd[s];
+				}
+			}
+		}
+
+		// greedy coloring of the spring blocks, each block takes the lowest color not yet used by
+		// any block sharing one of its nodes
+		static vector<unsigned int> colorBlocks(const vector<Spring>& springs, size_t numNodes) {
+			size_t blocks = (springs.size() + SPRING_BLOCK_SIZE - 1) / SPRING_BLOCK_SIZE;
+			vector<unsigned int> color(blocks, 0);
+
+			// used[node * words + w] has bit c set once a block of color 64 * w + c touched the node
+			size_t words = 1;
+			vector<uint64_t> used(numNodes * words, 0);
+			vector<uint64_t> taken;
+
+			for (size_t b = 0; b < blocks; ++b) {
+				size_t begin = b * SPRING_BLOCK_SIZE;
+				size_t end = std::min(springs.size(), begin + SPRING_BLOCK_SIZE);
+
+				taken.assign(words, 0);
+				for (size_t i = begin; i < end; ++i) {
+					for (size_t w = 0; w < words; ++w) {
+						taken[w] |= used[springs[i].v0 * words + w] | used[springs[i].v1 * words + w];
+					}
+				}
+
+				size_t w = 0;
+				while (w < words && taken[w] == ~uint64_t(0)) {
+					++w;
+				}
+				if (w == words) {
+					// every color so far is blocked, widen the masks
+					vector<uint64_t> wider(numNodes * (words + 1), 0);
+					for (size_t node = 0; node < numNodes; ++node) {
+						for (size_t x = 0; x < words; ++x) {
+							wider[node * (words + 1) + x] = used[node * words + x];
+						}
+					}
+					used.swap(wider);
+					taken.push_back(0);
+					++words;
+				}
+
+				unsigned int bit = 0;
+				while (taken[w] & (uint64_t(1) << bit)) {
+					++bit;
+				}
+				color[b] = (unsigned int)(w * 64 + bit);
+
+				for (size_t i = begin; i < end; ++i) {
+					used[springs[i].v0 * words + w] |= uint64_t(1) << bit;
+					used[springs[i].v1 * words + w] |= uint64_t(1) << bit;
+				}
+			}
+
+			return color;
+		}
+};
+
+// spring blocks per chunk handed to the thread pool
+const size_t SPRING_BATCH_GRAIN = 4;
+
+// runs fn(springBegin, springEnd) over every spring of topo. colors run one after another, blocks
+// inside a color never share a node, so fn may write both endpoints without synchronisation.
+// blocks of one color sit next to each other, so a run of them is one spring range
+template <typename F>
+void forEachSpringBatch(const CageTopology& topo, F&& fn) {
+	ThreadPool& pool = ThreadPool::shared();
+	for (size_t c = 0; c < topo.numColors(); ++c) {
+		pool.parallelFor(topo.colorOffsets[c], topo.colorOffsets[c + 1], SPRING_BATCH_GRAIN,
+			[&](size_t firstBlock, size_t lastBlock) {
+				fn(topo.blockOffsets[firstBlock], topo.blockOffsets[lastBlock]);
+			});
+	}
+}
+
+// forEachSpringBatch with every block handed to fn on its own. the ranges fn sees then depend only
+// on the topology and not on how the pool chunks a color, which matters for the simd kernels: where
+// a range ends decides which springs fall into the scalar tail
+template <typename F>
+void forEachSpringBlock(const CageTopology& topo, F&& fn) {
+	ThreadPool& pool = ThreadPool::shared();
+	for (size_t c = 0; c < topo.numColors(); ++c) {
+		pool.parallelFor(topo.colorOffsets[c], topo.colorOffsets[c + 1], SPRING_BATCH_GRAIN,
+			[&](size_t firstBlock, size_t lastBlock) {
+				for (size_t b = firstBlock; b < lastBlock; ++b) {
+					fn(topo.blockOffsets[b], topo.blockOffsets[b + 1]);
+				}
+			});
+	}
+}
+
+#endif
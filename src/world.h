@@ -0,0 +1,354 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "cage.h"
+
+// instances per pack, one per simd lane of the spring kernel
+const size_t WORLD_LANES = SPRING_KERNEL_WIDTH;
+
+// many copies of one cage stepped together, for scenes full of identical background jellos. the
+// instances share the prototype's shape and masses, only their nodes are stored per instance,
+// WORLD_LANES of them interleaved per pack: for every node the x of each instance in a row, then the
+// y's, then the z's. one pass over the springs then works on a whole pack, each lane a different
+// instance, with plain vector loads where a single cage needs gathers, and springs that share a node
+// can't collide because the lanes never mix. packs are independent and run on the thread pool.
+// the step is the cage's fused one with its drag, floor contact and stretch clamp, so an instance
+// follows a Cube in FUSED_STEP to rounding. what a cage has and an instance doesn't: no input, no
+// sleeping, and below a floorY under 0 the cage's nodes keep their stale force where these fall
+class CageWorld {
+	public:
+		float floorY = 0.0f;
+
+		// spring evaluations and seconds spent in tick since the last resetCounters
+		unsigned long long springEvaluations = 0;
+		double stepSeconds = 0.0;
+
+		CageWorld(const Cage& prototype) {
+			shape = prototype.shape;
+			rest = prototype.pts;
+			for (auto& p : rest.position) {
+				p += prototype.pos;
+			}
+			rest.previous.assign(rest.position.begin(), rest.position.end());
+			driven = prototype.driven;
+		}
+
+		size_t size() const {
+			return numInstances;
+		}
+
+		size_t numNodes() const {
+			return rest.size();
+		}
+
+		size_t numSprings() const {
+			return shape->topo.numSprings();
+		}
+
+		// new instance at rest, offset from the prototype by offset. returns its index
+		size_t add(vec3 offset) {
+			const size_t n = numNodes();
+			const size_t lane = numInstances % WORLD_LANES;
+			if (lane == 0) {
+				// a new pack, the lanes nobody has claimed yet run copies of the prototype
+				const size_t packSize = n * 3 * WORLD_LANES;
+				position.resize(position.size() + packSize);
+				previous.resize(previous.size() + packSize);
+				force.resize(force.size() + packSize, 0.0f);
+				for (size_t l = 0; l < WORLD_LANES; ++l) {
+					place(numInstances + l, vec3(0.0f));
+				}
+			}
+			place(numInstances, offset);
+			return numInstances++;
+		}
+
+		// substeps a tick of dt needs, from the prototype's stiffness at rest
+		int substepsFor(float dt) {
+			return timestepController.substeps(rest, shape->topo, dt, 0.0f);
+		}
+
+		void tick(float dt, int substeps) {
+			auto start = chrono::steady_clock::now();
+			for (int s = 0; s < substeps; ++s) {
+				step(dt / substeps);
+			}
+			stepSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		}
+
+		void step(float h) {
+			const size_t n = numNodes();
+			const size_t packSize = n * 3 * WORLD_LANES;
+			const float invH = 1.0f / h;
+			const float h2 = h * h;
+
+			ThreadPool::shared().parallelFor(0, numPacks(), 1, [&](size_t begin, size_t end) {
+				for (size_t pack = begin; pack < end; ++pack) {
+					const size_t base = pack * packSize;
+					float* p = position.data() + base;
+					float* q = previous.data() + base;
+					float* f = force.data() + base;
+					packSpringForces(shape->topo, p, q, f, invH);
+
+					for (size_t i = 0; i < n; ++i) {
+						const float invMass = rest.invMass[i];
+						// the cage's contact force for nodes resting at y 0, see fusedStep
+						const float contact = -9.8f * invMass;
+						// the driven nodes' drag without input, horizontal only
+						const float drag = driven[i] ? -INPUT_FRICTION * invH : 0.0f;
+						for (size_t c = 0; c < 3; ++c) {
+							float* pc = p + (i * 3 + c) * WORLD_LANES;
+							float* qc = q + (i * 3 + c) * WORLD_LANES;
+							float* fc = f + (i * 3 + c) * WORLD_LANES;
+							if (c == 1) {
+								for (size_t l = 0; l < WORLD_LANES; ++l) {
+									const float gravity = pc[l] > 0.0f ? GRAVITY.y : contact;
+									float next = pc[l] + (pc[l] - qc[l]) + (fc[l] * invMass + gravity) * h2;
+									next = std::max(next, floorY);
+									qc[l] = pc[l];
+									pc[l] = next;
+									fc[l] = 0.0f;
+								}
+								continue;
+							}
+							for (size_t l = 0; l < WORLD_LANES; ++l) {
+								const float v = pc[l] - qc[l];
+								float next = pc[l] + v + (fc[l] * invMass + drag * v) * h2;
+								qc[l] = pc[l];
+								pc[l] = next;
+								fc[l] = 0.0f;
+							}
+						}
+					}
+					packConstrain(shape->springs, p);
+				}
+			});
+			springEvaluations += (unsigned long long)numInstances * shape->topo.numSprings();
+		}
+
+		vec3 nodePosition(size_t instance, size_t node) const {
+			const float* p = position.data() + slot(instance, node);
+			return vec3(p[0], p[WORLD_LANES], p[2 * WORLD_LANES]);
+		}
+
+		// one instance's nodes in world space, for drawing
+		void copyPositions(size_t instance, vector<vec3>& out) const {
+			out.resize(numNodes());
+			for (size_t i = 0; i < out.size(); ++i) {
+				out[i] = nodePosition(instance, i);
+			}
+		}
+
+		double springsPerSecond() const {
+			return stepSeconds > 0.0 ? springEvaluations / stepSeconds : 0.0;
+		}
+
+		void resetCounters() {
+			springEvaluations = 0;
+			stepSeconds = 0.0;
+		}
+
+	private:
+		shared_ptr<const CageShape> shape;
+		// the prototype's nodes at rest in world space, and the masses every instance shares
+		NodeStore rest;
+		TimestepController timestepController;
+
+		size_t numInstances = 0;
+		aligned_vector<float> position;
+		aligned_vector<float> previous;
+		aligned_vector<float> force;
+		vector<unsigned char> driven;
+
+		size_t numPacks() const {
+			return (numInstances + WORLD_LANES - 1) / WORLD_LANES;
+		}
+
+		// index of the x of instance's node, its y and z follow WORLD_LANES and 2 WORLD_LANES later
+		size_t slot(size_t instance, size_t node) const {
+			const size_t pack = instance / WORLD_LANES;
+			return (pack * numNodes() + node) * 3 * WORLD_LANES + instance % WORLD_LANES;
+		}
+
+		void place(size_t instance, vec3 offset) {
+			for (size_t i = 0; i < numNodes(); ++i) {
+				const size_t at = slot(instance, i);
+				for (size_t c = 0; c < 3; ++c) {
+					position[at + c * WORLD_LANES] = rest.position[i][c] + offset[c];
+					previous[at + c * WORLD_LANES] = rest.position[i][c] + offset[c];
+				}
+			}
+		}
+
+		// the cage's springConstrain on every lane of one pack: springs pushed apart along y below
+		// 0.01 and pulled back to 1.1 times their rest length, one after the other in shape order
+		static void packConstrain(const vector<Spring>& springs, float* p) {
+			const float minDist = 0.01f;
+			for (auto& spring : springs) {
+				const float maxDist = 1.1f * spring.restLength;
+				float* a = p + spring.v0 * 3 * WORLD_LANES;
+				float* b = p + spring.v1 * 3 * WORLD_LANES;
+				for (size_t l = 0; l < WORLD_LANES; ++l) {
+					const float ex = b[l] - a[l];
+					const float ey = b[l + WORLD_LANES] - a[l + WORLD_LANES];
+					const float ez = b[l + 2 * WORLD_LANES] - a[l + 2 * WORLD_LANES];
+					const float distance = sqrt(ex * ex + ey * ey + ez * ez);
+					if (distance < minDist) {
+						const float half = 0.5f * (minDist - distance);
+						a[l + WORLD_LANES] -= half;
+						b[l + WORLD_LANES] += half;
+					}
+					if (distance > maxDist) {
+						const float scale = 0.5f * (distance - maxDist) / distance;
+						a[l] += ex * scale;
+						a[l + WORLD_LANES] += ey * scale;
+						a[l + 2 * WORLD_LANES] += ez * scale;
+						b[l] -= ex * scale;
+						b[l + WORLD_LANES] -= ey * scale;
+						b[l + 2 * WORLD_LANES] -= ez * scale;
+					}
+				}
+			}
+		}
+
+#if SPRING_KERNEL_WIDTH == 8
+
+		// every spring of one pack into f, p q and f point at the pack's first node
+		static void packSpringForces(const CageTopology& topo, const float* p, const float* q, float* f, float invDt) {
+			const __m256 vInvDt = _mm256_set1_ps(invDt);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			const __m256 threeHalves = _mm256_set1_ps(1.5f);
+			const __m256 minLen2 = _mm256_set1_ps(SPRING_MIN_LENGTH2);
+
+			for (size_t s = 0; s < topo.numSprings(); ++s) {
+				const size_t a = topo.v0[s] * 3 * 8;
+				const size_t b = topo.v1[s] * 3 * 8;
+
+				__m256 abx = _mm256_sub_ps(_mm256_load_ps(p + a), _mm256_load_ps(p + b));
+				__m256 aby = _mm256_sub_ps(_mm256_load_ps(p + a + 8), _mm256_load_ps(p + b + 8));
+				__m256 abz = _mm256_sub_ps(_mm256_load_ps(p + a + 16), _mm256_load_ps(p + b + 16));
+
+				__m256 pabx = _mm256_sub_ps(_mm256_load_ps(q + a), _mm256_load_ps(q + b));
+				__m256 paby = _mm256_sub_ps(_mm256_load_ps(q + a + 8), _mm256_load_ps(q + b + 8));
+				__m256 pabz = _mm256_sub_ps(_mm256_load_ps(q + a + 16), _mm256_load_ps(q + b + 16));
+
+				// 1 / |ab| with one newton step on top of rsqrt
+				__m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abx, abx), _mm256_mul_ps(aby, aby)), _mm256_mul_ps(abz, abz));
+				__m256 valid = _mm256_cmp_ps(len2, minLen2, _CMP_GT_OQ);
+				__m256 r = _mm256_rsqrt_ps(len2);
+				r = _mm256_mul_ps(r, _mm256_sub_ps(threeHalves, _mm256_mul_ps(_mm256_mul_ps(half, len2), _mm256_mul_ps(r, r))));
+				r = _mm256_and_ps(r, valid);
+
+				__m256 dx = _mm256_mul_ps(abx, r);
+				__m256 dy = _mm256_mul_ps(aby, r);
+				__m256 dz = _mm256_mul_ps(abz, r);
+
+				__m256 vx = _mm256_mul_ps(_mm256_sub_ps(abx, pabx), vInvDt);
+				__m256 vy = _mm256_mul_ps(_mm256_sub_ps(aby, paby), vInvDt);
+				__m256 vz = _mm256_mul_ps(_mm256_sub_ps(abz, pabz), vInvDt);
+				__m256 vAlong = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, dx), _mm256_mul_ps(vy, dy)), _mm256_mul_ps(vz, dz));
+
+				__m256 stretch = _mm256_sub_ps(_mm256_mul_ps(len2, r), _mm256_set1_ps(topo.restLength[s]));
+				__m256 magnitude = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(topo.k[s]), stretch),
+												 _mm256_mul_ps(_mm256_set1_ps(topo.kd[s]), vAlong));
+				magnitude = _mm256_and_ps(magnitude, valid);
+
+				__m256 fx = _mm256_mul_ps(magnitude, dx);
+				__m256 fy = _mm256_mul_ps(magnitude, dy);
+				__m256 fz = _mm256_mul_ps(magnitude, dz);
+				_mm256_store_ps(f + a, _mm256_sub_ps(_mm256_load_ps(f + a), fx));
+				_mm256_store_ps(f + a + 8, _mm256_sub_ps(_mm256_load_ps(f + a + 8), fy));
+				_mm256_store_ps(f + a + 16, _mm256_sub_ps(_mm256_load_ps(f + a + 16), fz));
+				_mm256_store_ps(f + b, _mm256_add_ps(_mm256_load_ps(f + b), fx));
+				_mm256_store_ps(f + b + 8, _mm256_add_ps(_mm256_load_ps(f + b + 8), fy));
+				_mm256_store_ps(f + b + 16, _mm256_add_ps(_mm256_load_ps(f + b + 16), fz));
+			}
+		}
+
+#elif SPRING_KERNEL_WIDTH == 4
+
+		static void packSpringForces(const CageTopology& topo, const float* p, const float* q, float* f, float invDt) {
+			const __m128 vInvDt = _mm_set1_ps(invDt);
+			const __m128 half = _mm_set1_ps(0.5f);
+			const __m128 threeHalves = _mm_set1_ps(1.5f);
+			const __m128 minLen2 = _mm_set1_ps(SPRING_MIN_LENGTH2);
+
+			for (size_t s = 0; s < topo.numSprings(); ++s) {
+				const size_t a = topo.v0[s] * 3 * 4;
+				const size_t b = topo.v1[s] * 3 * 4;
+
+				__m128 abx = _mm_sub_ps(_mm_load_ps(p + a), _mm_load_ps(p + b));
+				__m128 aby = _mm_sub_ps(_mm_load_ps(p + a + 4), _mm_load_ps(p + b + 4));
+				__m128 abz = _mm_sub_ps(_mm_load_ps(p + a + 8), _mm_load_ps(p + b + 8));
+
+				__m128 pabx = _mm_sub_ps(_mm_load_ps(q + a), _mm_load_ps(q + b));
+				__m128 paby = _mm_sub_ps(_mm_load_ps(q + a + 4), _mm_load_ps(q + b + 4));
+				__m128 pabz = _mm_sub_ps(_mm_load_ps(q + a + 8), _mm_load_ps(q + b + 8));
+
+				__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, abx), _mm_mul_ps(aby, aby)), _mm_mul_ps(abz, abz));
+				__m128 valid = _mm_cmpgt_ps(len2, minLen2);
+				__m128 r = _mm_rsqrt_ps(len2);
+				r = _mm_mul_ps(r, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, len2), _mm_mul_ps(r, r))));
+				r = _mm_and_ps(r, valid);
+
+				__m128 dx = _mm_mul_ps(abx, r);
+				__m128 dy = _mm_mul_ps(aby, r);
+				__m128 dz = _mm_mul_ps(abz, r);
+
+				__m128 vx = _mm_mul_ps(_mm_sub_ps(abx, pabx), vInvDt);
+				__m128 vy = _mm_mul_ps(_mm_sub_ps(aby, paby), vInvDt);
+				__m128 vz = _mm_mul_ps(_mm_sub_ps(abz, pabz), vInvDt);
+				__m128 vAlong = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+
+				__m128 stretch = _mm_sub_ps(_mm_mul_ps(len2, r), _mm_set1_ps(topo.restLength[s]));
+				__m128 magnitude = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(topo.k[s]), stretch),
+											  _mm_mul_ps(_mm_set1_ps(topo.kd[s]), vAlong));
+				magnitude = _mm_and_ps(magnitude, valid);
+
+				__m128 fx = _mm_mul_ps(magnitude, dx);
+				__m128 fy = _mm_mul_ps(magnitude, dy);
+				__m128 fz = _mm_mul_ps(magnitude, dz);
+				_mm_store_ps(f + a, _mm_sub_ps(_mm_load_ps(f + a), fx));
+				_mm_store_ps(f + a + 4, _mm_sub_ps(_mm_load_ps(f + a + 4), fy));
+				_mm_store_ps(f + a + 8, _mm_sub_ps(_mm_load_ps(f + a + 8), fz));
+				_mm_store_ps(f + b, _mm_add_ps(_mm_load_ps(f + b), fx));
+				_mm_store_ps(f + b + 4, _mm_add_ps(_mm_load_ps(f + b + 4), fy));
+				_mm_store_ps(f + b + 8, _mm_add_ps(_mm_load_ps(f + b + 8), fz));
+			}
+		}
+
+#else
+
+		static void packSpringForces(const CageTopology& topo, const float* p, const float* q, float* f, float invDt) {
+			for (size_t s = 0; s < topo.numSprings(); ++s) {
+				const size_t a = topo.v0[s] * 3;
+				const size_t b = topo.v1[s] * 3;
+				vec3 ab = vec3(p[a], p[a + 1], p[a + 2]) - vec3(p[b], p[b + 1], p[b + 2]);
+				float len2 = dot(ab, ab);
+				if (len2 <= SPRING_MIN_LENGTH2) {
+					continue;
+				}
+				float invLen = 1.0f / sqrt(len2);
+				vec3 dir = ab * invLen;
+				vec3 vDiff = (ab - (vec3(q[a], q[a + 1], q[a + 2]) - vec3(q[b], q[b + 1], q[b + 2]))) * invDt;
+				float magnitude = topo.k[s] * (len2 * invLen - topo.restLength[s]) + topo.kd[s] * dot(vDiff, dir);
+				for (size_t c = 0; c < 3; ++c) {
+					f[a + c] -= magnitude * dir[c];
+					f[b + c] += magnitude * dir[c];
+				}
+			}
+		}
+
+#endif
+};
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef XPBD_H
+#define XPBD_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+#include "nodestore.h"
+#include "topology.h"
+#include "threadpool.h"
+#include "springkernel.h"
+
+// springs a block is strided by when the solver packs its constraints, see XpbdSolver
+const size_t XPBD_INTERLEAVE = 32;
+
+// extended position based dynamics (macklin et al. 16) for a cage. every spring is a distance
+// constraint with compliance 1 / k, the floor is a contact constraint with zero compliance.
+// compliance is scaled by the substep and each constraint keeps its accumulated lambda across
+// iterations, so the converged stiffness doesn't depend on dt or the iteration count.
+// a color's spring blocks never share a node, so they're projected in parallel and each block is
+// walked gauss-seidel in order, the result doesn't depend on the thread count.
+// neighbouring springs of a block usually share a node, which chains every projection onto the
+// one before it, so the solver keeps its own copy of the constraints with each block interleaved
+class XpbdSolver {
+	public:
+		// the frame is split into substeps, each runs this many constraint passes
+		int substeps = 2;
+		int iterations = 5;
+
+		// advances pts by h. pts.force must hold the external forces, floorY is in local coordinates
+		void step(NodeStore& pts, const CageTopology& topo, float h, float floorY) {
+			const size_t n = pts.size();
+			if (&topo != builtFor || topo.revision != builtRevision) {
+				build(topo);
+			}
+			start.resize(n);
+
+			const float sub = h / substeps;
+			ThreadPool& pool = ThreadPool::shared();
+
+			for (int s = 0; s < substeps; ++s) {
+				// predict with the external forces
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						vec3 p = pts.position[i];
+						vec3 v_dt = (p - pts.previous[i]) * (sub / h);
+						start[i] = p;
+						pts.position[i] = p + v_dt + pts.force[i] * pts.invMass[i] * sub * sub;
+					}
+				});
+				fill(lambda.begin(), lambda.end(), 0.0f);
+
+				for (int it = 0; it < iterations; ++it) {
+					projectSprings(pts, topo, sub);
+					projectFloor(pts, floorY);
+				}
+
+				// previous keeps a full frame's displacement so the other modes read the same velocity
+				pool.parallelFor(0, n, SOLVER_GRAIN, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; ++i) {
+						pts.previous[i] = pts.position[i] - (pts.position[i] - start[i]) * (h / sub);
+					}
+				});
+			}
+		}
+
+	private:
+		// the topology's springs, each block reordered to j, j + XPBD_INTERLEAVE, j + 2 XPBD_INTERLEAVE ...
+		// block and color ranges are unchanged, so forEachSpringBatch still applies
+		aligned_vector<unsigned int> v0;
+		aligned_vector<unsigned int> v1;
+		aligned_vector<float> restLength;
+		aligned_vector<float> compliance;
+		// kd / k, the damping term is this over the substep
+		aligned_vector<float> dampingRatio;
+		aligned_vector<float> lambda;
+		aligned_vector<vec3> start;
+
+		const CageTopology* builtFor = nullptr;
+		unsigned int builtRevision = 0;
+
+		void build(const CageTopology& topo) {
+			size_t n = topo.numSprings();
+			v0.resize(n);
+			v1.resize(n);
+			restLength.resize(n);
+			compliance.resize(n);
+			dampingRatio.resize(n);
+			lambda.resize(n);
+
+			for (size_t b = 0; b < topo.numBlocks(); ++b) {
+				size_t begin = topo.blockOffsets[b];
+				size_t end = topo.blockOffsets[b + 1];
+				size_t dst = begin;
+				for (size_t r = 0; r < XPBD_INTERLEAVE; ++r) {
+					for (size_t src = begin + r; src < end; src += XPBD_INTERLEAVE, ++dst) {
+						// a spring with no stiffness gets no constraint
+						bool active = topo.k[src] > 0.0f;
+						v0[dst] = topo.v0[src];
+						v1[dst] = topo.v1[src];
+						restLength[dst] = topo.restLength[src];
+						compliance[dst] = active ? 1.0f / topo.k[src] : -1.0f;
+						dampingRatio[dst] = active ? topo.kd[src] / topo.k[src] : 0.0f;
+					}
+				}
+			}
+
+			builtFor = &topo;
+			builtRevision = topo.revision;
+		}
+
+		void projectSprings(NodeStore& pts, const CageTopology& topo, float sub) {
+			vec3* position = pts.position.data();
+			const vec3* origin = start.data();
+			const float* invMass = pts.invMass.data();
+			const float invSub = 1.0f / sub;
+			const float invSub2 = invSub * invSub;
+
+			forEachSpringBatch(topo, [&](size_t begin, size_t end) {
+				for (size_t s = begin; s < end; ++s) {
+					const unsigned int a = v0[s];
+					const unsigned int b = v1[s];
+					const float w = invMass[a] + invMass[b];
+
+					vec3 x = position[a] - position[b];
+					float len2 = dot(x, x);
+					if (w == 0.0f || len2 <= SPRING_MIN_LENGTH2 || compliance[s] < 0.0f) {
+						continue;
+					}
+					float len = sqrt(len2);
+					vec3 d = x / len;
+					float C = len - restLength[s];
+
+					// compliance and damping, scaled to the substep
+					float alpha = compliance[s] * invSub2;
+					float gamma = dampingRatio[s] * invSub;
+					float rate = dot(d, (position[a] - origin[a]) - (position[b] - origin[b]));
+
+					float dLambda = (-C - alpha * lambda[s] - gamma * rate) / ((1.0f + gamma) * w + alpha);
+					lambda[s] += dLambda;
+
+					position[a] += (dLambda * invMass[a]) * d;
+					position[b] -= (dLambda * invMass[b]) * d;
+				}
+			});
+		}
+
+		void projectFloor(NodeStore& pts, float floorY) {
+			ThreadPool::shared().parallelFor(0, pts.size(), SOLVER_GRAIN, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					if (pts.position[i].y < floorY) {
+						pts.position[i].y = floorY;
+					}
+				}
+			});
+		}
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "headless.h"
+#include "contact.h"
+
+#include <random>
+#include <tuple>
+#include <cstdio>
+
+// CageContacts::findCandidates against a brute force search over every pair of surface nodes. two
+// scenes: cubes scattered and overlapping in a small box, some of them asleep, and a floor of
+// cubes with a column stacked on it, where the boxes share x and z ranges. the candidates have to
+// be exactly the brute force pairs, and come out in the same order at 1 and at 4 threads
+
+typedef tuple<unsigned int, unsigned int, unsigned int, unsigned int> Pair;
+
+int failures = 0;
+
+vector<Pair> bruteForce(const vector<Cage*>& cages, float distance) {
+	vector<Pair> pairs;
+	for (unsigned int a = 0; a < cages.size(); ++a) {
+		for (unsigned int b = a + 1; b < cages.size(); ++b) {
+			if (cages[a]->sleepMonitor.asleep && cages[b]->sleepMonitor.asleep) {
+				continue;
+			}
+			for (unsigned int i : cages[a]->shape->surface) {
+				for (unsigned int j : cages[b]->shape->surface) {
+					vec3 d = (cages[a]->pts.position[i] + cages[a]->pos) - (cages[b]->pts.position[j] + cages[b]->pos);
+					if (dot(d, d) < distance * distance) {
+						pairs.emplace_back(a, i, b, j);
+					}
+				}
+			}
+		}
+	}
+	sort(pairs.begin(), pairs.end());
+	return pairs;
+}
+
+vector<Pair> found(const vector<ContactCandidate>& candidates) {
+	vector<Pair> pairs;
+	for (auto& c : candidates) {
+		pairs.emplace_back(c.cageA, c.nodeA, c.cageB, c.nodeB);
+	}
+	return pairs;
+}
+
+void check(const char* scene, const vector<Cage*>& cages) {
+	CageContacts contacts;
+	ThreadPool::shared().resize(1);
+	contacts.findCandidates(cages);
+	vector<Pair> single = found(contacts.candidates);
+	ThreadPool::shared().resize(4);
+	contacts.findCandidates(cages);
+	vector<Pair> four = found(contacts.candidates);
+
+	vector<Pair> expected = bruteForce(cages, contacts.distance);
+	vector<Pair> sorted = single;
+	sort(sorted.begin(), sorted.end());
+	bool ok = sorted == expected && four == single;
+	printf("%-32s %zu cages, %zu pairs, brute force %zu, %s at 4 threads %s\n", scene, cages.size(), single.size(),
+		expected.size(), four == single ? "same order" : "different order", ok ? "ok" : "FAILED");
+	if (!ok) {
+		++failures;
+	}
+}
+
+int main() {
+	initHeadless();
+
+	vector<unique_ptr<Cube>> scattered;
+	vector<Cage*> cages;
+	mt19937 rng(184);
+	uniform_real_distribution<float> place(0.0f, 3.0f);
+	for (int k = 0; k < 40; ++k) {
+		scattered.emplace_back(new Cube(1, 4, vec3(place(rng), place(rng), place(rng))));
+		scattered.back()->sleepMonitor.asleep = k % 3 == 0;
+		cages.push_back(scattered.back().get());
+	}
+	check("scattered, a third asleep", cages);
+
+	// a 6 x 6 floor of cubes 0.9 apart, so neighbours overlap, and a column of 12 on the middle one
+	vector<unique_ptr<Cube>> stacked;
+	cages.clear();
+	for (int x = 0; x < 6; ++x) {
+		for (int z = 0; z < 6; ++z) {
+			stacked.emplace_back(new Cube(1, 4, vec3(0.9f * x, 0.5f, 0.9f * z)));
+		}
+	}
+	for (int y = 1; y <= 12; ++y) {
+		stacked.emplace_back(new Cube(1, 4, vec3(2.7f, 0.5f + 0.95f * y, 2.7f)));
+	}
+	for (auto& cube : stacked) {
+		cages.push_back(cube.get());
+	}
+	check("floor and column", cages);
+
+	return failures == 0 ? 0 : 1;
+}
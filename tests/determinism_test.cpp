@@ -0,0 +1,61 @@
+#include "headless.h"
+#include "cage.h"
+
+#include <cstdio>
+
+// deterministic runs are bit identical at any thread count. every step mode drops the same cube
+// with the shared pool at 1 thread and at 4 and the two runs have to end on the same stateHash,
+// which folds in the positions after every step. the cube has more nodes than one SOLVER_GRAIN
+// chunk and more springs than one SPRING_BLOCK_SIZE block, so the work really is split
+
+struct Run {
+	const char* name;
+	StepMode mode;
+	ForceEvaluation evaluation;
+};
+
+const Run RUNS[] = {
+	{ "phased", PHASED_STEP, SCATTER_FORCES },
+	{ "fused scatter", FUSED_STEP, SCATTER_FORCES },
+	{ "fused gather", FUSED_STEP, GATHER_FORCES },
+	{ "implicit", IMPLICIT_STEP, SCATTER_FORCES },
+	{ "xpbd", XPBD_STEP, SCATTER_FORCES },
+	{ "projective", PROJECTIVE_STEP, SCATTER_FORCES },
+	{ "fem", FEM_STEP, SCATTER_FORCES },
+	{ "shape matching", SHAPE_MATCHING_STEP, SCATTER_FORCES },
+};
+
+const float DT = 1.0f / 60.0f;
+const int TICKS = 10;
+const unsigned int THREADS[] = { 1, 4 };
+
+uint64_t hashRun(const Run& run, unsigned int threads) {
+	ThreadPool::shared().resize(threads);
+	Cube cube(6, 3, vec3(0.0f, 3.1f, 0.0f));
+	cube.stepMode = run.mode;
+	cube.forceEvaluation = run.evaluation;
+	cube.deterministic = true;
+	cube.sleepMonitor.sleepTime = 1e9f;
+	for (int t = 0; t < TICKS; ++t) {
+		cube.tick(nullptr, DT, cube.substepsFor(DT));
+	}
+	return cube.stateHash.value;
+}
+
+int main() {
+	initHeadless();
+	int failures = 0;
+	for (const Run& run : RUNS) {
+		uint64_t hash[2];
+		for (int k = 0; k < 2; ++k) {
+			hash[k] = hashRun(run, THREADS[k]);
+		}
+		bool ok = hash[0] == hash[1];
+		printf("%-16s %u threads %016llx, %u threads %016llx %s\n", run.name, THREADS[0], (unsigned long long)hash[0],
+			THREADS[1], (unsigned long long)hash[1], ok ? "ok" : "FAILED");
+		if (!ok) {
+			++failures;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
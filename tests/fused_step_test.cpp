@@ -0,0 +1,80 @@
+#include "headless.h"
+#include "cage.h"
+
+#include <cstdio>
+
+// FUSED_STEP, with scatter and with gather forces, against the PHASED_STEP reference it replaced.
+// the cube starts just above the floor so the contact and clamp take part, and the arrow and space
+// input changes every 20 steps so the driven nodes' push and drag do. the fused pass adds the same
+// forces in another order, so the two agree to rounding rather than exactly
+
+struct Run {
+	const char* name;
+	int length;
+	int nodesPerLength;
+	int steps;
+	float tolerance;
+};
+
+const Run RUNS[] = {
+	{ "Cube(3, 2), 60 steps", 3, 2, 60, 6e-6f },
+	{ "Cube(10, 5), 5 steps", 10, 5, 5, 3e-5f },
+};
+
+const float DT = 1.0f / 480.0f;
+const vec3 INPUTS[] = {
+	vec3(INPUT_STRENGTH, 0.0f, 0.0f),
+	vec3(0.0f, 9.81f * 3, -INPUT_STRENGTH),
+	vec3(0.0f),
+	vec3(-INPUT_STRENGTH, 0.0f, INPUT_STRENGTH),
+};
+
+int failures = 0;
+
+// one tick of one step, the phases tick() runs with input from the keys in place of a window
+void stepWith(Cage& cage, vec3 input) {
+	cage.beginTick(input);
+	cage.stepForces(DT);
+	cage.stepIntegrate(DT);
+	cage.stepConstrain();
+	cage.endTick(DT, 1);
+}
+
+void prepare(Cage& cage, StepMode mode, ForceEvaluation evaluation) {
+	cage.stepMode = mode;
+	cage.forceEvaluation = evaluation;
+	cage.sleepMonitor.sleepTime = 1e9f;
+}
+
+int main() {
+	initHeadless();
+	for (const Run& run : RUNS) {
+		const vec3 start(0.0f, run.length / 2.0f + 0.02f, 0.0f);
+		Cube phased(run.length, run.nodesPerLength, start);
+		Cube scatter(run.length, run.nodesPerLength, start);
+		Cube gather(run.length, run.nodesPerLength, start);
+		prepare(phased, PHASED_STEP, SCATTER_FORCES);
+		prepare(scatter, FUSED_STEP, SCATTER_FORCES);
+		prepare(gather, FUSED_STEP, GATHER_FORCES);
+
+		float scatterError = 0.0f;
+		float gatherError = 0.0f;
+		for (int s = 0; s < run.steps; ++s) {
+			vec3 input = INPUTS[(s / 20) % (sizeof(INPUTS) / sizeof(INPUTS[0]))];
+			stepWith(phased, input);
+			stepWith(scatter, input);
+			stepWith(gather, input);
+			for (size_t i = 0; i < phased.pts.size(); ++i) {
+				scatterError = std::max(scatterError, distance(scatter.pts.position[i], phased.pts.position[i]));
+				gatherError = std::max(gatherError, distance(gather.pts.position[i], phased.pts.position[i]));
+			}
+		}
+
+		bool ok = scatterError <= run.tolerance && gatherError <= run.tolerance;
+		printf("%-24s scatter %9.3g, gather %9.3g (tolerance %g) %s\n", run.name, scatterError, gatherError, run.tolerance, ok ? "ok" : "FAILED");
+		if (!ok) {
+			++failures;
+		}
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#include "headless.h"
+#include "cage.h"
+
+#include <random>
+#include <cstdio>
+
+// springForcesSimd against the springForcesScalar reference on a perturbed Cube. the simd kernel
+// takes its inverse length from rsqrt and one newton step, so the two agree to a few ulps per
+// spring rather than exactly. forces are compared relative to the largest force, energy and strain
+// relative to their own size
+
+const float FORCE_TOLERANCE = 1e-4f;
+// the simd kernel divides by the rest length through an approximate reciprocal
+const float STRAIN_TOLERANCE = 1e-3f;
+
+int failures = 0;
+
+void check(bool ok, const char* what, double error, double tolerance) {
+	printf("%-48s %12.3g (tolerance %g) %s\n", what, error, tolerance, ok ? "ok" : "FAILED");
+	if (!ok) {
+		++failures;
+	}
+}
+
+// largest |simd - scalar| over every node's force against the largest scalar force, springs
+// [begin, end)
+double compareForces(const CageTopology& topo, const NodeStore& pts, size_t begin, size_t end, float invDt) {
+	vector<vec3> scalar(pts.size(), vec3(0.0f));
+	vector<vec3> simd(pts.size(), vec3(0.0f));
+	springForcesScalar(topo, begin, end, pts.position.data(), pts.previous.data(), scalar.data(), invDt);
+	springForcesSimd(topo, begin, end, pts.position.data(), pts.previous.data(), simd.data(), invDt);
+
+	float largest = 0.0f;
+	float error = 0.0f;
+	for (size_t i = 0; i < pts.size(); ++i) {
+		largest = std::max(largest, length(scalar[i]));
+		error = std::max(error, length(simd[i] - scalar[i]));
+	}
+	return largest > 0.0f ? error / largest : error;
+}
+
+int main() {
+	initHeadless();
+	printf("spring kernel width %d\n", SPRING_KERNEL_WIDTH);
+
+	Cube cube(2, 4);
+	NodeStore pts = cube.pts;
+	const CageTopology& topo = cube.shape->topo;
+	const float invDt = 480.0f;
+
+	// stretch and squash the springs and give the nodes some velocity so the damping term counts
+	mt19937 rng(184);
+	uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+	for (size_t i = 0; i < pts.size(); ++i) {
+		pts.position[i] += vec3(jitter(rng), jitter(rng), jitter(rng));
+		pts.previous[i] = pts.position[i] + vec3(jitter(rng), jitter(rng), jitter(rng)) * 0.1f;
+	}
+
+	const size_t n = topo.numSprings();
+	double error = compareForces(topo, pts, 0, n, invDt);
+	check(error <= FORCE_TOLERANCE, "forces, every spring", error, FORCE_TOLERANCE);
+
+	// a range that starts and ends off the vector width, so the scalar tail runs too
+	error = compareForces(topo, pts, 3, n - 5, invDt);
+	check(error <= FORCE_TOLERANCE, "forces, unaligned range", error, FORCE_TOLERANCE);
+
+	SpringEnergy scalarEnergy;
+	SpringEnergy simdEnergy;
+	vector<vec3> force(pts.size(), vec3(0.0f));
+	springForcesScalar(topo, 0, n, pts.position.data(), pts.previous.data(), force.data(), invDt, &scalarEnergy);
+	springForcesSimd(topo, 0, n, pts.position.data(), pts.previous.data(), force.data(), invDt, &simdEnergy);
+
+	error = fabs(simdEnergy.potential - scalarEnergy.potential) / scalarEnergy.potential;
+	check(error <= FORCE_TOLERANCE, "spring potential energy", error, FORCE_TOLERANCE);
+	error = fabs(simdEnergy.maxStrain - scalarEnergy.maxStrain) / scalarEnergy.maxStrain;
+	check(error <= STRAIN_TOLERANCE, "max strain", error, STRAIN_TOLERANCE);
+
+	return failures == 0 ? 0 : 1;
+}